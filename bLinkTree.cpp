@@ -0,0 +1,349 @@
+/* B-Link Tree
+ * Summary:	A Lehman-Yao b-link tree with high keys, right links, and bottom up splits.
+ */
+
+
+#pragma once
+
+
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+
+
+using namespace std;
+
+
+// Constructor for b-link trees.
+// t is the minimum degree of the tree.
+// compare is the comparison functor used for managing elements within the tree.
+template <typename T, typename Compare>
+BLinkTree<T, Compare>::BLinkTree(unsigned t, Compare compare) : lessThan(compare) {
+	minDegree = t;
+
+	// Lay out a node's block: header, then keys, then children,
+	// padded out to a whole number of cache lines.
+	keyOffset = roundUp(sizeof(BLinkNode<T>), alignof(T));
+	childOffset = roundUp(keyOffset + (2 * minDegree - 1) * sizeof(T), alignof(BLinkNode<T>*));
+	pool.init(roundUp(childOffset + 2 * minDegree * sizeof(BLinkNode<T>*), CACHE_LINE_SIZE));
+
+	root = newNode(0);
+}
+
+
+// Destructor.
+// Every node is on some level, so walking each level from its first node finds them all.
+template <typename T, typename Compare>
+BLinkTree<T, Compare>::~BLinkTree() {
+	BLinkNode<T> *first = root;
+	while (first != NULL) {
+		BLinkNode<T> *below = first->level == 0 ? NULL : first->child[0];
+		for (BLinkNode<T> *x = first; x != NULL;) {
+			BLinkNode<T> *next = x->right;
+			destroy_n(x->key, 2 * minDegree - 1);
+			x->~BLinkNode<T>();
+			x = next;
+		}
+		first = below;
+	}
+	pool.release();
+}
+
+
+// Inserts a copy of the key k into the tree if it is not already present.
+template <typename T, typename Compare>
+bool BLinkTree<T, Compare>::insert(const T &k) {
+	return insert(T(k));
+}
+
+
+// Inserts the key k into the tree if it is not already present.
+// Returns whether k was inserted.
+// A full leaf is split first, and the separator for its new neighbor
+// is added to the level above once the leaf has been let go.
+template <typename T, typename Compare>
+bool BLinkTree<T, Compare>::insert(T &&k) {
+	BLinkNode<T> *path[BTREE_MAX_HEIGHT];
+	rootLatch.lock_shared();
+	unsigned height = root->level;
+	rootLatch.unlock_shared();
+
+	BLinkNode<T> *leaf = descend(k, 0, path);
+	leaf->latch.lock();
+	leaf = moveRight(leaf, k, true);
+
+	unsigned index = searchKeys<false>(leaf->key, leaf->size, k, lessThan);
+	if (index < leaf->size && !lessThan(k, leaf->key[index])) {
+		leaf->latch.unlock();
+		return false;
+	}
+
+	// Make room if the leaf is full, and find which half k goes in.
+	BLinkNode<T> *sibling = NULL;
+	BLinkNode<T> *target = leaf;
+	if (leaf->size == 2 * minDegree - 1) {
+		sibling = splitNode(leaf);
+		if (!lessThan(k, leaf->high)) {
+			target = sibling;
+		}
+		index = searchKeys<false>(target->key, target->size, k, lessThan);
+	}
+
+	for (unsigned j = target->size; j > index; j--) {
+		target->key[j] = std::move(target->key[j - 1]);
+	}
+	target->key[index] = std::move(k);
+	target->size++;
+
+	if (sibling == NULL) {
+		leaf->latch.unlock();
+		return true;
+	}
+	T separator = leaf->high;
+	leaf->latch.unlock();
+	insertParent(std::move(separator), sibling, 0, path, height);
+	return true;
+}
+
+
+// Removes k from its leaf.
+// Returns whether k was present.
+template <typename T, typename Compare>
+bool BLinkTree<T, Compare>::remove(const T &k) {
+	BLinkNode<T> *leaf = descend(k, 0, NULL);
+	leaf->latch.lock();
+	leaf = moveRight(leaf, k, true);
+
+	unsigned index = searchKeys<false>(leaf->key, leaf->size, k, lessThan);
+	bool found = index < leaf->size && !lessThan(k, leaf->key[index]);
+	if (found) {
+		leaf->size--;
+		for (unsigned j = index; j < leaf->size; j++) {
+			leaf->key[j] = std::move(leaf->key[j + 1]);
+		}
+	}
+	leaf->latch.unlock();
+	return found;
+}
+
+
+// Whether a key equivalent to k is in the tree.
+template <typename T, typename Compare>
+bool BLinkTree<T, Compare>::contains(const T &k) {
+	return lookup(k, [](const T&) {});
+}
+
+
+// Copy of the key equivalent to k, if there is one.
+template <typename T, typename Compare>
+optional<T> BLinkTree<T, Compare>::find(const T &k) {
+	optional<T> found;
+	lookup(k, [&found](const T &key) {
+		found.emplace(key);
+	});
+	return found;
+}
+
+
+// Calls f on each key k with lo <= k < hi.
+// The walk stops at the first leaf whose high key isn't less than hi.
+template <typename T, typename Compare>
+template <typename F>
+void BLinkTree<T, Compare>::forRange(const T &lo, const T &hi, F f) {
+	if (!lessThan(lo, hi)) {
+		return;
+	}
+	BLinkNode<T> *leaf = descend(lo, 0, NULL);
+	leaf->latch.lock_shared();
+	leaf = moveRight(leaf, lo, false);
+	unsigned index = searchKeys<false>(leaf->key, leaf->size, lo, lessThan);
+	while (true) {
+		for (; index < leaf->size && lessThan(leaf->key[index], hi); index++) {
+			f(leaf->key[index]);
+		}
+		if (leaf->right == NULL || !lessThan(leaf->high, hi)) {
+			leaf->latch.unlock_shared();
+			return;
+		}
+		BLinkNode<T> *next = leaf->right;
+		leaf->latch.unlock_shared();
+		next->latch.lock_shared();
+		leaf = next;
+		index = 0;
+	}
+}
+
+
+// Allocates a b-link tree node at level.
+// Leaves get the same size of block, but no child array.
+template <typename T, typename Compare>
+BLinkNode<T> *BLinkTree<T, Compare>::newNode(unsigned level) {
+	char *block = (char*) pool.allocate();
+	BLinkNode<T> *x = new (block) BLinkNode<T>;
+	x->key = (T*) (block + keyOffset);
+	x->child = level == 0 ? NULL : (BLinkNode<T>**) (block + childOffset);
+	uninitialized_default_construct_n(x->key, 2 * minDegree - 1);
+	x->right = NULL;
+	x->size = 0;
+	x->level = level;
+	return x;
+}
+
+
+// Walks down to the node on level whose range should hold k, recording the path in path if it isn't NULL.
+// Only one latch is held at a time. A child read from a node may split before it is latched,
+// but the keys that move go to its right, where moveRight finds them.
+template <typename T, typename Compare>
+BLinkNode<T> *BLinkTree<T, Compare>::descend(const T &k, unsigned level, BLinkNode<T> **path) {
+	rootLatch.lock_shared();
+	BLinkNode<T> *x = root;
+	rootLatch.unlock_shared();
+
+	while (x->level > level) {
+		x->latch.lock_shared();
+		x = moveRight(x, k, false);
+		if (path != NULL) {
+			path[x->level] = x;
+		}
+		BLinkNode<T> *next = x->child[searchKeys<true>(x->key, x->size, k, lessThan)];
+		x->latch.unlock_shared();
+		x = next;
+	}
+	return x;
+}
+
+
+// Moves right from x, which is latched, while k is not less than its high key.
+// Nodes split only to the right, so a node's right link found here never skips past k's node.
+template <typename T, typename Compare>
+BLinkNode<T> *BLinkTree<T, Compare>::moveRight(BLinkNode<T> *x, const T &k, bool exclusive) {
+	while (x->right != NULL && !lessThan(k, x->high)) {
+		BLinkNode<T> *next = x->right;
+		if (exclusive) {
+			x->latch.unlock();
+			next->latch.lock();
+		}
+		else {
+			x->latch.unlock_shared();
+			next->latch.lock_shared();
+		}
+		x = next;
+	}
+	return x;
+}
+
+
+// Splits x, which is full and latched exclusively, into x and a new right neighbor.
+// A leaf keeps minDegree - 1 keys and the first key of the new leaf becomes its high key.
+// An inner node keeps minDegree - 1 separators and its middle separator becomes its high key.
+// The new node takes over x's high key and right link.
+template <typename T, typename Compare>
+BLinkNode<T> *BLinkTree<T, Compare>::splitNode(BLinkNode<T> *x) {
+	BLinkNode<T> *sibling = newNode(x->level);
+	sibling->right = x->right;
+	if (x->right != NULL) {
+		sibling->high = std::move(x->high);
+	}
+
+	if (x->level == 0) {
+		for (unsigned j = 0; j < minDegree; j++) {
+			sibling->key[j] = std::move(x->key[j + minDegree - 1]);
+		}
+		sibling->size = minDegree;
+		x->high = sibling->key[0];
+	}
+	else {
+		for (unsigned j = 0; j < minDegree - 1; j++) {
+			sibling->key[j] = std::move(x->key[j + minDegree]);
+		}
+		for (unsigned j = 0; j < minDegree; j++) {
+			sibling->child[j] = x->child[j + minDegree];
+		}
+		sibling->size = minDegree - 1;
+		x->high = std::move(x->key[minDegree - 1]);
+	}
+	x->size = minDegree - 1;
+	x->right = sibling;
+	return sibling;
+}
+
+
+// Inserts separator into x with child as the child to its right.
+template <typename T, typename Compare>
+void BLinkTree<T, Compare>::insertEntry(BLinkNode<T> *x, T &&separator, BLinkNode<T> *child) {
+	unsigned index = searchKeys<true>(x->key, x->size, separator, lessThan);
+	for (unsigned j = x->size; j > index; j--) {
+		x->key[j] = std::move(x->key[j - 1]);
+		x->child[j + 1] = x->child[j];
+	}
+	x->key[index] = std::move(separator);
+	x->child[index + 1] = child;
+	x->size++;
+}
+
+
+// Links node, which was split off at level with separator as its first bound, into the level above.
+// The parent is the node recorded on the way down, moved right as needed. If the insert
+// came down from the top level, the tree either grows a level here or has already grown
+// one, and the parent is found from the new root. Each node that fills up is split
+// and let go before its own separator goes up.
+template <typename T, typename Compare>
+void BLinkTree<T, Compare>::insertParent(T &&separator, BLinkNode<T> *node, unsigned level, BLinkNode<T> **path, unsigned height) {
+	while (true) {
+		BLinkNode<T> *parent;
+		if (level < height) {
+			parent = path[level + 1];
+		}
+		else {
+
+			// Grow upwards if node's level is still the top one.
+			// The root is the first node on its level, so it goes on the left.
+			rootLatch.lock();
+			if (root->level == level) {
+				BLinkNode<T> *newRoot = newNode(level + 1);
+				newRoot->child[0] = root;
+				newRoot->key[0] = std::move(separator);
+				newRoot->child[1] = node;
+				newRoot->size = 1;
+				root = newRoot;
+				rootLatch.unlock();
+				return;
+			}
+			rootLatch.unlock();
+			parent = descend(separator, level + 1, NULL);
+		}
+
+		parent->latch.lock();
+		parent = moveRight(parent, separator, true);
+		if (parent->size < 2 * minDegree - 1) {
+			insertEntry(parent, std::move(separator), node);
+			parent->latch.unlock();
+			return;
+		}
+
+		BLinkNode<T> *sibling = splitNode(parent);
+		insertEntry(lessThan(separator, parent->high) ? parent : sibling, std::move(separator), node);
+		separator = parent->high;
+		node = sibling;
+		level++;
+		parent->latch.unlock();
+	}
+}
+
+
+// Searches for k, calling f on it while its leaf is latched shared.
+template <typename T, typename Compare>
+template <typename F>
+bool BLinkTree<T, Compare>::lookup(const T &k, F f) {
+	BLinkNode<T> *leaf = descend(k, 0, NULL);
+	leaf->latch.lock_shared();
+	leaf = moveRight(leaf, k, false);
+	unsigned index = searchKeys<false>(leaf->key, leaf->size, k, lessThan);
+	bool found = index < leaf->size && !lessThan(k, leaf->key[index]);
+	if (found) {
+		f(leaf->key[index]);
+	}
+	leaf->latch.unlock_shared();
+	return found;
+}
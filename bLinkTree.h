@@ -0,0 +1,143 @@
+/* B-Link Tree
+ * Summary:	A Lehman-Yao b-link tree that threads can search and change at the same time.
+ *			Like a B+ Tree, all keys live in the leaves. Every node also has a high key
+ *			bounding its keys and a link to the next node on its level, so a thread that
+ *			reaches a node after it was split just follows the link to the right.
+ *			Nodes split bottom up, and every operation holds at most one latch at a time.
+ *			Removing a key never merges nodes. Leaves may be left empty.
+ *			Keys are unique.
+ *			Search, insert, and remove run in O(lg(n)) time when nothing is split under them.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+
+#include "bTree.h"
+#include "nodeLatch.h"
+#include "nodePool.h"
+
+
+// struct for representing nodes of a b-link tree.
+// Each node is one cache-line-aligned block holding this header,
+// followed by the key array and, for inner nodes, the child array.
+template <typename T>
+struct BLinkNode {
+	BLinkNode<T> **child;	// Array of pointers to children. NULL in leaves.
+	T *key;					// Array of keys in leaves, or of separators in inner nodes.
+	BLinkNode<T> *right;	// Next node on the same level, or NULL for the last one.
+	T high;					// Every key under the node is less than this. Unused when right is NULL.
+	unsigned size;			// Number of keys.
+	unsigned level;			// Height above the leaves, which are level 0.
+	NodeLatch latch;		// Held shared to read the node and exclusively to change it.
+};
+
+
+// class for representing b-link trees.
+// Compare is the type of the key-comparison functor. It is called as a less-than.
+// In an inner node, child[i] holds the keys k with key[i - 1] <= k < key[i].
+// A node may be missing from its parent for a moment after a split.
+// It is then reached through the link from its left neighbor.
+template <typename T, typename Compare = std::less<T>>
+class BLinkTree {
+public:
+	// Constructor
+	// First parameter is the minimum degree of the tree.
+	// Second parameter is the tree's key-comparison functor.
+	// Constant time.
+	BLinkTree(unsigned, Compare = defaultCompare<Compare>());
+
+	// Destructor.
+	// Linear time.
+	~BLinkTree();
+
+	BLinkTree(const BLinkTree&) = delete;
+	BLinkTree &operator=(const BLinkTree&) = delete;
+
+	// Inserts a key into the tree.
+	// Returns false, and leaves the tree unchanged, if an equivalent key is already present.
+	// Splits propagate up the path the insert came down, one node and one latch at a time.
+	// Logorithmic time.
+	bool insert(const T&);
+	bool insert(T&&);
+
+	// Removes a key from its leaf, without merging or rebalancing.
+	// Returns whether the key was present.
+	// Logorithmic time.
+	bool remove(const T&);
+
+	// Whether an equivalent key is in the tree.
+	// Logorithmic time.
+	bool contains(const T&);
+
+	// Copy of the key equivalent to the parameter, or nothing if there is none.
+	// Logorithmic time.
+	std::optional<T> find(const T&);
+
+	// Calls a function on each key not less than the first parameter and less than the second, in order.
+	// Walks the leaves through their links, latching one at a time, so keys changed
+	// concurrently in leaves not yet reached may or may not be seen.
+	// The function must not change the tree.
+	// Logorithmic time plus linear time in the number of leaves visited.
+	template <typename F>
+	void forRange(const T&, const T&, F);
+
+private:
+
+	// Allocates and initializes a node at a level.
+	BLinkNode<T> *newNode(unsigned);
+
+	// Walks down from the root to the node at a level whose range should hold a key.
+	// Latches each node shared on the way, one at a time, and moves right past nodes that split.
+	// If the third parameter isn't NULL, the node passed through at each level above is stored at that index.
+	// Returns the node unlatched, since nodes are never freed while the tree is alive.
+	BLinkNode<T> *descend(const T&, unsigned, BLinkNode<T>**);
+
+	// Follows right links from a latched node until reaching the one whose range holds a key.
+	// Lets go of each node before latching the next. Third parameter is whether the latches are exclusive.
+	// Returns the latched node.
+	BLinkNode<T> *moveRight(BLinkNode<T>*, const T&, bool);
+
+	// Moves the upper half of a full, exclusively latched node into a new right neighbor and links it in.
+	// The node's high key becomes the separator for the new node.
+	// The new node isn't latched, since nothing can reach it until the node is unlatched.
+	BLinkNode<T> *splitNode(BLinkNode<T>*);
+
+	// Inserts a separator and the child to its right into an inner node that isn't full.
+	void insertEntry(BLinkNode<T>*, T&&, BLinkNode<T>*);
+
+	// Adds a separator and a new node to the level above the new node, splitting nodes as needed.
+	// Fourth parameter is the path the insert came down, as filled in by descend,
+	// and the fifth is the level of the root when it did.
+	void insertParent(T&&, BLinkNode<T>*, unsigned, BLinkNode<T>**, unsigned);
+
+	// Searches for a key, and calls a function on it while its leaf is latched.
+	// Returns whether the key was found.
+	template <typename F>
+	bool lookup(const T&, F);
+
+	// Guards the root pointer. Held exclusively only to add a level.
+	NodeLatch rootLatch;
+
+	// Root node. Always the first node on the highest level.
+	BLinkNode<T> *root;
+
+	// Comparison functor used for managing element placement.
+	Compare lessThan;
+
+	// Minimum degree of the tree.
+	unsigned minDegree;
+
+	// Offsets of the key and child arrays within a node's block.
+	std::size_t keyOffset;
+	std::size_t childOffset;
+
+	// Slabs that node blocks are carved from. Shared between threads.
+	// Nodes are never merged, so blocks only go back when the tree is destroyed.
+	NodePool<std::allocator<char>, CACHE_LINE_SIZE, true> pool;
+};
+
+
+#include "bLinkTree.cpp"
@@ -0,0 +1,492 @@
+/* B+ Tree
+ * Summary:	A B+ Tree data structure with linked leaves for range scans.
+ */
+
+
+#pragma once
+
+
+#include <memory>
+#include <new>
+#include <utility>
+
+
+using namespace std;
+
+
+// Constructor for b+ tree.
+// t is the minimum degree of the tree.
+// compare is the comparison functor used for managing elements within the tree.
+template <typename T, typename Compare>
+BPlusTree<T, Compare>::BPlusTree(unsigned t, Compare compare) : lessThan(compare) {
+	minDegree = t;
+	count = 0;
+
+	// Lay out a node's block: header, then keys, then children,
+	// padded out to a whole number of cache lines.
+	keyOffset = roundUp(sizeof(BPlusNode<T>), alignof(T));
+	childOffset = roundUp(keyOffset + (2 * minDegree - 1) * sizeof(T), alignof(BPlusNode<T>*));
+	leafSize = roundUp(childOffset, CACHE_LINE_SIZE);
+	innerSize = roundUp(childOffset + 2 * minDegree * sizeof(BPlusNode<T>*), CACHE_LINE_SIZE);
+
+	root = newNode(true);
+	head = root;
+}
+
+
+// Destructor.
+template <typename T, typename Compare>
+BPlusTree<T, Compare>::~BPlusTree() {
+	freeNode(root);
+}
+
+
+// Inserts a copy of the key k into the tree if it is not already present.
+template <typename T, typename Compare>
+bool BPlusTree<T, Compare>::insert(const T &k) {
+	if (contains(k)) {
+		return false;
+	}
+	return insert(T(k));
+}
+
+
+// Inserts the key k into the tree if it is not already present.
+// Returns whether k was inserted.
+template <typename T, typename Compare>
+bool BPlusTree<T, Compare>::insert(T &&k) {
+
+	// Grow upwards if the root is full.
+	if (root->size == 2 * minDegree - 1) {
+		BPlusNode<T> *newRoot = newNode(false);
+		newRoot->child[0] = root;
+		root = newRoot;
+		splitChild(newRoot, 0);
+	}
+
+	// Work down the tree, splitting full children on the way.
+	BPlusNode<T> *curr = root;
+	while (!curr->leaf) {
+		unsigned index = searchKeys<true>(curr->key, curr->size, k, lessThan);
+		if (curr->child[index]->size == 2 * minDegree - 1) {
+			splitChild(curr, index);
+			if (!lessThan(k, curr->key[index])) {
+				index++;
+			}
+		}
+		curr = curr->child[index];
+	}
+
+	// Insert into the leaf unless k is already there.
+	unsigned index = searchKeys<false>(curr->key, curr->size, k, lessThan);
+	if (index < curr->size && !lessThan(k, curr->key[index])) {
+		return false;
+	}
+	for (unsigned j = curr->size; j > index; j--) {
+		curr->key[j] = std::move(curr->key[j - 1]);
+	}
+	curr->key[index] = std::move(k);
+	curr->size++;
+	count++;
+	return true;
+}
+
+
+// Removes k from the tree.
+// Returns whether k was present.
+template <typename T, typename Compare>
+bool BPlusTree<T, Compare>::remove(const T &k) {
+
+	// Work down the tree, making sure each child visited can lose a key.
+	BPlusNode<T> *curr = root;
+	while (!curr->leaf) {
+		unsigned index = searchKeys<true>(curr->key, curr->size, k, lessThan);
+		if (fixChildSize(curr, index) == NEW_ROOT) {
+			curr = root;
+		}
+		else {
+			curr = curr->child[searchKeys<true>(curr->key, curr->size, k, lessThan)];
+		}
+	}
+
+	// Delete from the leaf.
+	unsigned index = searchKeys<false>(curr->key, curr->size, k, lessThan);
+	if (index == curr->size || lessThan(k, curr->key[index])) {
+		return false;
+	}
+	curr->size--;
+	for (unsigned j = index; j < curr->size; j++) {
+		curr->key[j] = std::move(curr->key[j + 1]);
+	}
+	count--;
+	return true;
+}
+
+
+// Whether a key equivalent to k is in the tree.
+template <typename T, typename Compare>
+bool BPlusTree<T, Compare>::contains(const T &k) {
+	BPlusNode<T> *leaf = findLeaf(k);
+	unsigned index = searchKeys<false>(leaf->key, leaf->size, k, lessThan);
+	return index < leaf->size && !lessThan(k, leaf->key[index]);
+}
+
+
+// Number of keys in the tree.
+template <typename T, typename Compare>
+size_t BPlusTree<T, Compare>::size() const {
+	return count;
+}
+
+
+// Iterator to the smallest key in the tree.
+template <typename T, typename Compare>
+typename BPlusTree<T, Compare>::const_iterator BPlusTree<T, Compare>::begin() const {
+	if (count == 0) {
+		return const_iterator();
+	}
+	return const_iterator(head, 0);
+}
+
+
+// Iterator past the largest key in the tree.
+template <typename T, typename Compare>
+typename BPlusTree<T, Compare>::const_iterator BPlusTree<T, Compare>::end() const {
+	return const_iterator();
+}
+
+
+// Iterator to the first key that is not less than k.
+template <typename T, typename Compare>
+typename BPlusTree<T, Compare>::const_iterator BPlusTree<T, Compare>::lower_bound(const T &k) {
+	BPlusNode<T> *leaf = findLeaf(k);
+	unsigned index = searchKeys<false>(leaf->key, leaf->size, k, lessThan);
+
+	// Every key in the following leaves is greater than k.
+	if (index == leaf->size) {
+		return const_iterator(leaf->next, 0);
+	}
+	return const_iterator(leaf, index);
+}
+
+
+// Iterator to the first key that is greater than k.
+template <typename T, typename Compare>
+typename BPlusTree<T, Compare>::const_iterator BPlusTree<T, Compare>::upper_bound(const T &k) {
+	BPlusNode<T> *leaf = findLeaf(k);
+	unsigned index = searchKeys<true>(leaf->key, leaf->size, k, lessThan);
+	if (index == leaf->size) {
+		return const_iterator(leaf->next, 0);
+	}
+	return const_iterator(leaf, index);
+}
+
+
+// The keys from lo through hi.
+template <typename T, typename Compare>
+typename BPlusTree<T, Compare>::Range BPlusTree<T, Compare>::range(const T &lo, const T &hi) {
+	if (lessThan(hi, lo)) {
+		return Range(end(), end());
+	}
+	return Range(lower_bound(lo), upper_bound(hi));
+}
+
+
+// Allocates a b+ tree node.
+// leaf is whether the node is a leaf. Leaves get a smaller block with no child array.
+template <typename T, typename Compare>
+BPlusNode<T> *BPlusTree<T, Compare>::newNode(bool leaf) {
+	char *block = (char*) ::operator new(leaf ? leafSize : innerSize, align_val_t(CACHE_LINE_SIZE));
+	BPlusNode<T> *x = new (block) BPlusNode<T>;
+	x->key = (T*) (block + keyOffset);
+	x->child = leaf ? NULL : (BPlusNode<T>**) (block + childOffset);
+	uninitialized_default_construct_n(x->key, 2 * minDegree - 1);
+	x->prev = NULL;
+	x->next = NULL;
+	x->size = 0;
+	x->leaf = leaf;
+	return x;
+}
+
+
+// Destroys the keys of x and releases its block.
+template <typename T, typename Compare>
+void BPlusTree<T, Compare>::deleteNode(BPlusNode<T> *x) {
+	destroy_n(x->key, 2 * minDegree - 1);
+	x->~BPlusNode<T>();
+	::operator delete((void*) x, align_val_t(CACHE_LINE_SIZE));
+}
+
+
+// Recursively deletes the subtree rooted at x.
+// Does the dirty work for the destructor.
+template <typename T, typename Compare>
+void BPlusTree<T, Compare>::freeNode(BPlusNode<T> *x) {
+	if (!x->leaf) {
+		for (unsigned i = 0; i <= x->size; i++) {
+			freeNode(x->child[i]);
+		}
+	}
+	deleteNode(x);
+}
+
+
+// Finds the leaf whose range of keys includes k.
+template <typename T, typename Compare>
+BPlusNode<T> *BPlusTree<T, Compare>::findLeaf(const T &k) {
+	BPlusNode<T> *x = root;
+	while (!x->leaf) {
+		x = x->child[searchKeys<true>(x->key, x->size, k, lessThan)];
+	}
+	return x;
+}
+
+
+// Function for splitting nodes that are too full.
+// x points to the parent of the node to split.
+// i is the index in x's child array of the node to split.
+// A split leaf keeps all of its keys and copies the first key of the new leaf up to x.
+// A split inner node moves its middle separator up to x.
+template <typename T, typename Compare>
+void BPlusTree<T, Compare>::splitChild(BPlusNode<T> *x, unsigned i) {
+	BPlusNode<T> *toSplit = x->child[i];
+	BPlusNode<T> *sibling = newNode(toSplit->leaf);
+	T separator;
+
+	if (toSplit->leaf) {
+
+		// Move the upper minDegree keys into the new leaf.
+		for (unsigned j = 0; j < minDegree; j++) {
+			sibling->key[j] = std::move(toSplit->key[j + minDegree - 1]);
+		}
+		sibling->size = minDegree;
+		toSplit->size = minDegree - 1;
+		separator = sibling->key[0];
+
+		// Link the new leaf in after the old one.
+		sibling->prev = toSplit;
+		sibling->next = toSplit->next;
+		if (toSplit->next != NULL) {
+			toSplit->next->prev = sibling;
+		}
+		toSplit->next = sibling;
+	}
+	else {
+
+		// Move the upper minDegree - 1 separators and minDegree children into the new node.
+		for (unsigned j = 0; j < minDegree - 1; j++) {
+			sibling->key[j] = std::move(toSplit->key[j + minDegree]);
+		}
+		for (unsigned j = 0; j < minDegree; j++) {
+			sibling->child[j] = toSplit->child[j + minDegree];
+		}
+		sibling->size = minDegree - 1;
+		toSplit->size = minDegree - 1;
+		separator = std::move(toSplit->key[minDegree - 1]);
+	}
+
+	// Add the separator and new node to x.
+	for (unsigned j = x->size; j > i; j--) {
+		x->key[j] = std::move(x->key[j - 1]);
+		x->child[j + 1] = x->child[j];
+	}
+	x->key[i] = std::move(separator);
+	x->child[i + 1] = sibling;
+	x->size++;
+}
+
+
+// Merges the (i + 1)th child of parent into the ith child of parent.
+// Merged leaves drop their separator, and merged inner nodes pull it down.
+// If the root is left empty, its only child becomes the new root.
+// Returns an indicator of whether the change affected the root.
+template <typename T, typename Compare>
+char BPlusTree<T, Compare>::mergeChildren(BPlusNode<T> *parent, unsigned i) {
+	BPlusNode<T> *leftKid = parent->child[i];
+	BPlusNode<T> *rightKid = parent->child[i + 1];
+
+	if (leftKid->leaf) {
+		for (unsigned j = 0; j < rightKid->size; j++) {
+			leftKid->key[leftKid->size + j] = std::move(rightKid->key[j]);
+		}
+		leftKid->size += rightKid->size;
+
+		// Unlink the right leaf.
+		leftKid->next = rightKid->next;
+		if (rightKid->next != NULL) {
+			rightKid->next->prev = leftKid;
+		}
+	}
+	else {
+		leftKid->key[leftKid->size] = std::move(parent->key[i]);
+		unsigned j = leftKid->size + 1;
+		for (unsigned k = 0; k < rightKid->size; k++) {
+			leftKid->key[j + k] = std::move(rightKid->key[k]);
+			leftKid->child[j + k] = rightKid->child[k];
+		}
+		leftKid->child[j + rightKid->size] = rightKid->child[rightKid->size];
+		leftKid->size = j + rightKid->size;
+	}
+	deleteNode(rightKid);
+
+	// Remove the separator and right child from parent.
+	parent->size--;
+	for (unsigned j = i; j < parent->size; j++) {
+		parent->key[j] = std::move(parent->key[j + 1]);
+		parent->child[j + 1] = parent->child[j + 2];
+	}
+
+	// If parent is empty, than it must have been the root.
+	if (parent->size == 0) {
+		root = leftKid;
+		deleteNode(parent);
+		return NEW_ROOT;
+	}
+
+	return MODIFIED_NOT_ROOT;
+}
+
+
+// Makes sure parent->child[index] has at least minDegree keys,
+// so that a key can be removed from it.
+// Borrows a key from a sibling if one can spare it, and otherwise merges with a sibling.
+// Returns a code indicating what action was taken.
+template <typename T, typename Compare>
+char BPlusTree<T, Compare>::fixChildSize(BPlusNode<T> *parent, unsigned index) {
+	BPlusNode<T> *kid = parent->child[index];
+	if (kid->size >= minDegree) {
+		return NOT_MODIFIED;
+	}
+
+	// Borrow from left sibling if possible.
+	if (index != 0 && parent->child[index - 1]->size >= minDegree) {
+		BPlusNode<T> *leftKid = parent->child[index - 1];
+		for (unsigned j = kid->size; j > 0; j--) {
+			kid->key[j] = std::move(kid->key[j - 1]);
+		}
+		if (kid->leaf) {
+			kid->key[0] = std::move(leftKid->key[leftKid->size - 1]);
+			parent->key[index - 1] = kid->key[0];
+		}
+		else {
+			for (unsigned j = kid->size + 1; j > 0; j--) {
+				kid->child[j] = kid->child[j - 1];
+			}
+			kid->key[0] = std::move(parent->key[index - 1]);
+			kid->child[0] = leftKid->child[leftKid->size];
+			parent->key[index - 1] = std::move(leftKid->key[leftKid->size - 1]);
+		}
+		leftKid->size--;
+		kid->size++;
+	}
+
+	// Borrow from right sibling if possible.
+	else if (index != parent->size && parent->child[index + 1]->size >= minDegree) {
+		BPlusNode<T> *rightKid = parent->child[index + 1];
+		if (kid->leaf) {
+			kid->key[kid->size] = std::move(rightKid->key[0]);
+		}
+		else {
+			kid->key[kid->size] = std::move(parent->key[index]);
+			kid->child[kid->size + 1] = rightKid->child[0];
+			parent->key[index] = std::move(rightKid->key[0]);
+			for (unsigned j = 0; j < rightKid->size; j++) {
+				rightKid->child[j] = rightKid->child[j + 1];
+			}
+		}
+		kid->size++;
+		rightKid->size--;
+		for (unsigned j = 0; j < rightKid->size; j++) {
+			rightKid->key[j] = std::move(rightKid->key[j + 1]);
+		}
+		if (kid->leaf) {
+			parent->key[index] = rightKid->key[0];
+		}
+	}
+
+	// If borrowing is not possible, then merge.
+	else if (index != parent->size) {
+		return mergeChildren(parent, index);
+	}
+	else {
+		return mergeChildren(parent, index - 1);
+	}
+	return MODIFIED_NOT_ROOT;
+}
+
+
+// Constructs an end iterator.
+template <typename T, typename Compare>
+BPlusTree<T, Compare>::const_iterator::const_iterator() : node(NULL), index(0) {}
+
+
+// Constructs an iterator to node->key[index].
+template <typename T, typename Compare>
+BPlusTree<T, Compare>::const_iterator::const_iterator(BPlusNode<T> *n, unsigned i) : node(n), index(i) {}
+
+
+// The key the iterator is at.
+template <typename T, typename Compare>
+const T &BPlusTree<T, Compare>::const_iterator::operator*() const {
+	return node->key[index];
+}
+
+
+// The key the iterator is at.
+template <typename T, typename Compare>
+const T *BPlusTree<T, Compare>::const_iterator::operator->() const {
+	return &node->key[index];
+}
+
+
+// Moves to the next key, following the link to the next leaf at the end of a leaf.
+template <typename T, typename Compare>
+typename BPlusTree<T, Compare>::const_iterator &BPlusTree<T, Compare>::const_iterator::operator++() {
+	if (++index == node->size) {
+		node = node->next;
+		index = 0;
+	}
+	return *this;
+}
+
+
+// Moves to the next key and returns the iterator's old position.
+template <typename T, typename Compare>
+typename BPlusTree<T, Compare>::const_iterator BPlusTree<T, Compare>::const_iterator::operator++(int) {
+	const_iterator old = *this;
+	++*this;
+	return old;
+}
+
+
+// Whether two iterators are at the same key.
+template <typename T, typename Compare>
+bool BPlusTree<T, Compare>::const_iterator::operator==(const const_iterator &other) const {
+	return node == other.node && index == other.index;
+}
+
+
+// Whether two iterators are at different keys.
+template <typename T, typename Compare>
+bool BPlusTree<T, Compare>::const_iterator::operator!=(const const_iterator &other) const {
+	return !(*this == other);
+}
+
+
+// Constructs the range [first, last).
+template <typename T, typename Compare>
+BPlusTree<T, Compare>::Range::Range(const_iterator f, const_iterator l) : first(f), last(l) {}
+
+
+// Iterator to the first key in the range.
+template <typename T, typename Compare>
+typename BPlusTree<T, Compare>::const_iterator BPlusTree<T, Compare>::Range::begin() const {
+	return first;
+}
+
+
+// Iterator past the last key in the range.
+template <typename T, typename Compare>
+typename BPlusTree<T, Compare>::const_iterator BPlusTree<T, Compare>::Range::end() const {
+	return last;
+}
@@ -0,0 +1,191 @@
+/* B+ Tree
+ * Summary:	A B+ Tree data structure.
+ *			All keys live in the leaves, and inner nodes only hold separators.
+ *			The leaves are linked in both directions, so ordered scans walk
+ *			from leaf to leaf without going back up the tree.
+ *			Keys are unique.
+ *			Search, insert, and remove run in O(lg(n)) time.
+ *			A range scan runs in O(lg(n) + m) time, where m is the number of keys it visits.
+ */
+
+
+#pragma once
+
+#include <iterator>
+#include <utility>
+
+#include "bTree.h"
+
+
+// struct for representing nodes of a b+ tree.
+// Each node is one cache-line-aligned block holding this header,
+// followed by the key array and, for inner nodes, the child array.
+template <typename T>
+struct BPlusNode {
+	BPlusNode<T> **child;	// Array of pointers to children. NULL in leaves.
+	T *key;					// Array of keys in leaves, or of separators in inner nodes.
+	BPlusNode<T> *prev;		// Previous leaf. Only used in leaves.
+	BPlusNode<T> *next;		// Next leaf. Only used in leaves.
+	unsigned size;			// Number of keys.
+	bool leaf;				// Whether the node is a leaf.
+};
+
+
+// class for representing b+ trees.
+// Compare is the type of the key-comparison functor. It is called as a less-than.
+// In an inner node, child[i] holds the keys k with key[i - 1] <= k < key[i].
+template <typename T, typename Compare = std::less<T>>
+class BPlusTree {
+public:
+
+	// Iterator over the keys of the tree in order.
+	// Invalidated by any change to the tree.
+	class const_iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const T *pointer;
+		typedef const T &reference;
+
+		// Constructs an end iterator.
+		const_iterator();
+
+		const T &operator*() const;
+		const T *operator->() const;
+
+		// Moves to the next key.
+		// Constant time.
+		const_iterator &operator++();
+		const_iterator operator++(int);
+
+		bool operator==(const const_iterator&) const;
+		bool operator!=(const const_iterator&) const;
+
+	private:
+		friend class BPlusTree;
+
+		const_iterator(BPlusNode<T>*, unsigned);
+
+		// Leaf holding the current key, or NULL at the end.
+		BPlusNode<T> *node;
+
+		// Index of the current key in node->key.
+		unsigned index;
+	};
+
+	// The keys in a range, for use in range-based for loops.
+	class Range {
+	public:
+		const_iterator begin() const;
+		const_iterator end() const;
+
+	private:
+		friend class BPlusTree;
+
+		Range(const_iterator, const_iterator);
+
+		const_iterator first;
+		const_iterator last;
+	};
+
+	// Constructor
+	// First parameter is the minimum degree of the tree.
+	// Second parameter is the tree's key-comparison functor.
+	// Constant time.
+	BPlusTree(unsigned, Compare = defaultCompare<Compare>());
+
+	// Destructor.
+	// Linear time.
+	~BPlusTree();
+
+	BPlusTree(const BPlusTree&) = delete;
+	BPlusTree &operator=(const BPlusTree&) = delete;
+
+	// Inserts a key into the tree.
+	// Returns false, and leaves the tree unchanged, if an equivalent key is already present.
+	// Logorithmic time.
+	bool insert(const T&);
+	bool insert(T&&);
+
+	// Removes a key from the tree.
+	// Returns whether the key was present.
+	// Logorithmic time.
+	bool remove(const T&);
+
+	// Whether an equivalent key is in the tree.
+	// Logorithmic time.
+	bool contains(const T&);
+
+	// Number of keys in the tree.
+	// Constant time.
+	std::size_t size() const;
+
+	// Iterators over all of the keys in order.
+	// begin is constant time. end is constant time.
+	const_iterator begin() const;
+	const_iterator end() const;
+
+	// Iterator to the first key not less than a key.
+	// Logorithmic time.
+	const_iterator lower_bound(const T&);
+
+	// Iterator to the first key greater than a key.
+	// Logorithmic time.
+	const_iterator upper_bound(const T&);
+
+	// The keys k with lo <= k <= hi, in order.
+	// Finding the range takes logorithmic time,
+	// and walking it follows the leaf links without revisiting inner nodes.
+	Range range(const T&, const T&);
+
+private:
+
+	// Allocates and initializes a node as a single block.
+	BPlusNode<T> *newNode(bool);
+
+	// Destroys a node's keys and releases its block.
+	void deleteNode(BPlusNode<T>*);
+
+	// Recursive function called by destructor.
+	void freeNode(BPlusNode<T>*);
+
+	// Finds the leaf that would hold a key.
+	BPlusNode<T> *findLeaf(const T&);
+
+	// Function for splitting nodes that are too full.
+	void splitChild(BPlusNode<T>*, unsigned);
+
+	// Merges two children of a node at a given index into one child.
+	char mergeChildren(BPlusNode<T>*, unsigned);
+
+	// Makes sure the child of a node at a specified index has >= minDegree keys.
+	char fixChildSize(BPlusNode<T>*, unsigned);
+
+	// Root node.
+	BPlusNode<T> *root;
+
+	// Leftmost leaf.
+	BPlusNode<T> *head;
+
+	// Comparison functor used for managing element placement.
+	Compare lessThan;
+
+	// Minimum degree of the tree.
+	unsigned minDegree;
+
+	// Number of keys in the tree.
+	std::size_t count;
+
+	// Offsets of the key and child arrays within a node's block.
+	std::size_t keyOffset;
+	std::size_t childOffset;
+
+	// Sizes in bytes of the blocks of leaves and inner nodes.
+	// Multiples of CACHE_LINE_SIZE. Leaves have no child array.
+	std::size_t leafSize;
+	std::size_t innerSize;
+};
+
+
+#include "bPlusTree.cpp"
@@ -8,7 +8,11 @@
 #pragma once
 
 
-#include <stdlib.h>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <optional>
+#include <vector>
 #include <utility>
 #include <stdio.h>
 
@@ -21,115 +25,367 @@ using namespace std;
 #define NOT_MODIFIED 0
 
 
+// Rounds n up to a multiple of align.
+static inline size_t roundUp(size_t n, size_t align) {
+	return (n + align - 1) / align * align;
+}
+
+
+// Returns Compare(), refusing function pointers, which would come out NULL and crash on first use.
+// Only instantiated where a constructor's comparison parameter is left out.
+template <typename Compare>
+Compare defaultCompare() {
+	static_assert(!is_pointer<Compare>::value, "a function pointer comparison must be passed to the constructor");
+	return Compare();
+}
+
+
+// Finds the index of the first of the n sorted keys that k is less than if Upper is true,
+// or that is not less than k otherwise.
+// Large ranges are narrowed down with a branchless binary search first.
+// Arithmetic keys in their default order are then counted with vector compares.
+template <bool Upper, typename T, typename Compare>
+unsigned searchKeys(const T *keys, unsigned n, const T &k, Compare &lessThan) {
+	const T *base = keys;
+	while (n > BTREE_BINARY_SEARCH_THRESHOLD) {
+		unsigned half = n / 2;
+		if (Upper) {
+			base = lessThan(k, base[half - 1]) ? base : base + half;
+		}
+		else {
+			base = lessThan(base[half - 1], k) ? base + half : base;
+		}
+		n -= half;
+	}
+	if constexpr (SimdKeySearch<T, Compare>::enabled) {
+		return (base - keys) + simdCountKeys<Upper>(base, n, k);
+	}
+	unsigned i = 0;
+	while (i < n && (Upper ? !lessThan(k, base[i]) : lessThan(base[i], k))) {
+		i++;
+	}
+	return (base - keys) + i;
+}
+
+
 // Constructor for b tree.
 // t is the minimum degree of the tree.
-// compare is the comparison function used for managing elements within the tree.
+// compare is the comparison functor used for managing elements within the tree.
 // printK is a function that prints keys.
-template <typename T>
-BTree<T>::BTree(unsigned t, bool (*compare)(T, T), void (*printK)(T)) {
-	minDegree = t;
-	lessThan = compare;
-	root = (BNode<T>*) malloc(sizeof(BNode<T>));
-	initializeNode(root);
-	root->leaf = true;
+// alloc is the allocator node slabs come from.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::BTree(unsigned t, Compare compare, void (*printK)(T), const Alloc &alloc) : lessThan(compare), retireNode(NULL), retireContext(NULL), pool(alloc) {
+	minDegree = Degree == DYNAMIC_DEGREE ? t : Degree;
 	printKey = printK;
+
+	// Lay out a node's block: header, then keys, then children,
+	// padded out to a whole number of cache lines.
+	// Values, if any, go last so that they don't spread the keys over more lines.
+	if constexpr (Degree == DYNAMIC_DEGREE) {
+		keyOffset = roundUp(sizeof(BNode<T, Degree, Mapped, Counted, Monoid, Latched>), alignof(T));
+		childOffset = roundUp(keyOffset + (2 * minDegree - 1) * sizeof(T), alignof(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*));
+		valueOffset = childOffset + 2 * minDegree * sizeof(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*);
+		if constexpr (!is_void<Mapped>::value) {
+			valueOffset = roundUp(valueOffset, alignof(Mapped));
+			nodeSize = roundUp(valueOffset + (2 * minDegree - 1) * sizeof(Mapped), CACHE_LINE_SIZE);
+		}
+		else {
+			nodeSize = roundUp(valueOffset, CACHE_LINE_SIZE);
+		}
+	}
+	else {
+		keyOffset = 0;
+		childOffset = 0;
+		valueOffset = 0;
+		nodeSize = roundUp(sizeof(BNode<T, Degree, Mapped, Counted, Monoid, Latched>), CACHE_LINE_SIZE);
+	}
+	pool.init(nodeSize);
+
+	root = newNode();
+	root->leaf = true;
+}
+
+
+// Constructor for b trees with a compile-time degree.
+// compare is the comparison functor used for managing elements within the tree.
+// printK is a function that prints keys.
+// alloc is the allocator node slabs come from.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::BTree(Compare compare, void (*printK)(T), const Alloc &alloc) : BTree(Degree, compare, printK, alloc) {}
+
+
+// Constructor for a b tree of the sorted keys in [first, last).
+// t is the minimum degree of the tree.
+// fillFactor is the fraction of each node to fill.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+template <typename InputIt>
+BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::BTree(unsigned t, InputIt first, InputIt last, double fillFactor, Compare compare, void (*printK)(T), const Alloc &alloc) : BTree(t, compare, printK, alloc) {
+	bulkLoad(first, last, fillFactor);
+}
+
+
+// Constructor for a b tree with a compile-time degree of the sorted keys in [first, last).
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+template <typename InputIt>
+BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::BTree(InputIt first, InputIt last, double fillFactor, Compare compare, void (*printK)(T), const Alloc &alloc) : BTree(Degree, compare, printK, alloc) {
+	bulkLoad(first, last, fillFactor);
 }
 
 
 // Destructor.
-template <typename T>
-BTree<T>::~BTree<T>() {
-	freeNode(root);
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::~BTree() {
+	freeAll();
+}
+
+
+// Removes every key from the tree, leaving an empty root.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::clear() {
+	freeAll();
+	root = newNode();
+	root->leaf = true;
+}
+
+
+// Inserts a copy of the key k into the tree.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::insert(const T &k) {
+	insert(T(k));
+}
+
+
+// Constructs a key from args and inserts it into the tree.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+template <typename... Args>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::emplace(Args&&... args) {
+	insert(T(std::forward<Args>(args)...));
 }
 
 
 // Inserts the key k into the tree.
-template <typename T>
-void BTree<T>::insert(T k) {
+// k is moved into its leaf rather than copied.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::insert(T &&k) {
 
 	// Grow upwards if the root is full.
-	if (root->size == 2 * minDegree - 1) {
-		BNode<T> *newRoot = (BNode<T>*) malloc(sizeof(BNode<T>));
-		initializeNode(newRoot);
+	if (root->size == 2 * degree() - 1) {
+		BNode<T, Degree, Mapped, Counted, Monoid, Latched> *newRoot = newNode();
 		newRoot->leaf = false;
 		newRoot->child[0] = root;
 		root = newRoot;
 		splitChild(newRoot, 0);
+		refreshNode(newRoot);
 	}
 
 	// Work down the tree.
-	BNode<T> *curr = root;
+	// The path is kept so its counts and aggregates can be updated after the key is inserted.
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *path[BTREE_MAX_HEIGHT];
+	unsigned depth = 0;
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *curr = root;
 	while (!curr->leaf) {
+		path[depth++] = curr;
 
 		// Find the proper child to go to.
-		int index = curr->size - 1;
-		while (index >= 0 && lessThan(k, curr->key[index])) {
-			index--;
-		}
-		index++;
+		unsigned index = findUpperIndex(curr, k);
+		prefetchNode(curr->child[index]);
 
 		// Split child if full.
-		if (curr->child[index]->size == 2 * minDegree - 1) {
+		if (curr->child[index]->size == 2 * degree() - 1) {
+			splitChild(curr, index);
+			if (lessThan(curr->key[index], k)) {
+				index++;
+			}
+		}
+		curr = curr->child[index];
+	}
+
+	path[depth++] = curr;
+	nodeInsert(curr, std::move(k));
+	refreshPath(path, depth, 1);
+}
+
+
+// Inserts the key k into the tree if no equivalent key is present.
+// Works like insert, but checks each node on the way down for k.
+// Splitting full nodes on the way to a key that is already present is harmless.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+pair<pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned>, bool> BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::insertUnique(T &&k) {
+
+	// Grow upwards if the root is full.
+	if (root->size == 2 * degree() - 1) {
+		BNode<T, Degree, Mapped, Counted, Monoid, Latched> *newRoot = newNode();
+		newRoot->leaf = false;
+		newRoot->child[0] = root;
+		root = newRoot;
+		splitChild(newRoot, 0);
+		refreshNode(newRoot);
+	}
+
+	// Work down the tree.
+	// The path is kept so its counts and aggregates can be updated if the key is inserted.
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *path[BTREE_MAX_HEIGHT];
+	unsigned depth = 0;
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *curr = root;
+	while (true) {
+		path[depth++] = curr;
+		unsigned index = findIndex(curr, k);
+		if (!curr->leaf) {
+			prefetchNode(curr->child[index]);
+		}
+
+		// Found an equivalent key.
+		if (index < curr->size && !lessThan(k, curr->key[index])) {
+			return make_pair(make_pair(curr, index), false);
+		}
+
+		// Insert at the bottom of the tree.
+		if (curr->leaf) {
+			nodeInsertAt(curr, index, std::move(k));
+			refreshPath(path, depth, 1);
+			return make_pair(make_pair(curr, index), true);
+		}
+
+		// Split child if full. The key moved up may be the one we're looking for.
+		if (curr->child[index]->size == 2 * degree() - 1) {
 			splitChild(curr, index);
 			if (lessThan(curr->key[index], k)) {
 				index++;
 			}
+			else if (!lessThan(k, curr->key[index])) {
+				return make_pair(make_pair(curr, index), false);
+			}
 		}
 		curr = curr->child[index];
 	}
+}
+
+
+// Inserts the keys in [first, last).
+// The batch is sorted and then handed down the tree, each child getting the run of keys
+// that belongs in it. Nodes that overflow split into several nodes at once,
+// and the root is grown by as many levels as needed at the end.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+template <typename InputIt>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::insertBatch(InputIt first, InputIt last) {
+	static_assert(is_void<Mapped>::value, "insertBatch only inserts keys");
+	vector<T> keys(first, last);
+	if (keys.empty()) {
+		return;
+	}
+	sort(keys.begin(), keys.end(), lessThan);
 
-	nodeInsert(curr, k);
+	vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> nodes;
+	vector<T> separators;
+	insertRun(root, keys.data(), keys.data() + keys.size(), nodes, separators);
+	if (nodes.empty()) {
+		return;
+	}
+
+	// Stack new roots on top until a level fits in one node.
+	while (nodes.size() > 1) {
+		vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> children;
+		vector<T> childSeparators;
+		children.swap(nodes);
+		childSeparators.swap(separators);
+		nodes.assign(1, newNode());
+		repartition(childSeparators, children, nodes, separators);
+	}
+	root = nodes[0];
 }
 
 
 // Removes k from the tree. Returns the removed key.
 // Throws a BTREE_EXCEPTION if key is not found.
-template <typename T>
-T BTree<T>::remove(T k) {
-	BNode<T> *curr = root;
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+T BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::remove(const T &k) {
+	T removed;
+	if (!erase(k, &removed)) {
+		throw (BTREE_EXCEPTION) REMOVE_KEY_NOT_FOUND;
+	}
+	return removed;
+}
+
+
+// Removes k from the tree if it is present.
+// If out isn't NULL, the removed key is moved into it.
+// Returns whether a key was removed.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+bool BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::erase(const T &k, T *out) {
+
+	// The path is kept so its counts and aggregates can be updated if a key is removed.
+	// It starts over if the root is merged away.
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *path[BTREE_MAX_HEIGHT];
+	unsigned depth = 0;
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *curr = root;
 	while (true) {
+		path[depth++] = curr;
 		unsigned i = findIndex(curr, k);
+		if (!curr->leaf) {
+			prefetchNode(curr->child[i]);
+		}
 
 		// If the item to be deleted has been found.
 		if (i < curr->size && !(lessThan(curr->key[i], k) || lessThan(k, curr->key[i]))) {
-			T toReturn = curr->key[i];
 
 			// If at a leaf, just delete it.
 			if (curr->leaf) {
-				nodeDelete(curr, i);
+				T removed = nodeDelete(curr, i);
+				if (out != NULL) {
+					*out = std::move(removed);
+				}
+				refreshPath(path, depth, -1);
+				return true;
 			}
 
 			// Otherwise replace with predecessor/successor or merge children.
 			else {
-				BNode<T> *leftKid = curr->child[i];
-				BNode<T> *rightKid = curr->child[i + 1];
+				BNode<T, Degree, Mapped, Counted, Monoid, Latched> *leftKid = curr->child[i];
+				BNode<T, Degree, Mapped, Counted, Monoid, Latched> *rightKid = curr->child[i + 1];
 
 				// Replace with predecessor.
-				if (leftKid->size >= minDegree) {
+				if (leftKid->size >= degree()) {
+					path[depth++] = leftKid;
 					while (!(leftKid->leaf)) {
 						fixChildSize(leftKid, leftKid->size);
 						leftKid = leftKid->child[leftKid->size];
+						path[depth++] = leftKid;
+					}
+					if (out != NULL) {
+						*out = std::move(curr->key[i]);
 					}
-					curr->key[i] = nodeDelete(leftKid, leftKid->size - 1);
+					moveEntry(curr, i, leftKid, leftKid->size - 1);
+					nodeClose(leftKid, leftKid->size - 1);
+					refreshPath(path, depth, -1);
+					return true;
 				}
 
 				// Replace with successor
-				else if (rightKid->size >= minDegree) {
+				else if (rightKid->size >= degree()) {
+					path[depth++] = rightKid;
 					while (!(rightKid->leaf)) {
 						fixChildSize(rightKid, 0);
 						rightKid = rightKid->child[0];
+						path[depth++] = rightKid;
 					}
-					curr->key[i] = nodeDelete(rightKid, 0);
+					if (out != NULL) {
+						*out = std::move(curr->key[i]);
+					}
+					moveEntry(curr, i, rightKid, 0);
+					nodeClose(rightKid, 0);
+					refreshPath(path, depth, -1);
+					return true;
 				}
 
 				// Merge children and move down the tree.
 				else {
-					mergeChildren(curr, i);
+					if (mergeChildren(curr, i) == NEW_ROOT) {
+						depth = 0;
+					}
 					curr = leftKid;
 					continue;
 				}
 			}
-			return toReturn;
 		}
 
 		// If the item has not been found, move down the tree.
@@ -137,12 +393,13 @@ T BTree<T>::remove(T k) {
 
 			// If at a leaf, then the item isn't present.
 			if (curr->leaf) {
-				throw (BTREE_EXCEPTION) REMOVE_KEY_NOT_FOUND;
+				return false;
 			}
 
 			// Adjust curr and move down the tree.
 			char result = fixChildSize(curr, i);
 			if (result == NEW_ROOT) {
+				depth = 0;
 				curr = root;
 			}
 			else {
@@ -156,26 +413,30 @@ T BTree<T>::remove(T k) {
 // Function to find a key in the tree.
 // returnValue.first is the node the item is in.
 // returnValue.second is the correct index in that node's key array
-template <typename T>
-pair<BNode<T>*, unsigned> BTree<T>::search(T k) {
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned> BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::search(const T &k) {
 
 	// Start at root.
-	BNode<T> *x = root;
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = root;
 
 	// Work down the tree.
 	while (true) {
 
 		// Find the proper index in the current node's array.
+		// Start loading the child it leads to while checking for a match.
 		unsigned i = findIndex(x, k);
+		if (!x->leaf) {
+			prefetchNode(x->child[i]);
+		}
 
 		// Found it!
 		if (i < x->size && !(lessThan(k, x->key[i]) || lessThan(x->key[i], k))) {
-			return pair<BNode<T>*, unsigned>(x, i);
+			return pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned>(x, i);
 		}
 
 		// Hit the bottom of the tree.
 		else if (x->leaf) {
-			return pair<BNode<T>*, unsigned>(NULL, 0);
+			return pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned>(NULL, 0);
 		}
 
 		// Keep going.
@@ -189,9 +450,9 @@ pair<BNode<T>*, unsigned> BTree<T>::search(T k) {
 // Function to find a key in the tree.
 // Returns the key.
 // If the item was not found an exception is thrown.
-template <typename T>
-T BTree<T>::searchKey(T k) {
-	pair<BNode<T>*, unsigned> node = search(k);
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+const T &BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::searchKey(const T &k) {
+	pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned> node = search(k);
 	if (node.first == NULL) {
 		throw (BTREE_EXCEPTION) SEARCH_KEY_NOT_FOUND;
 	}
@@ -199,9 +460,460 @@ T BTree<T>::searchKey(T k) {
 }
 
 
+// Looks up keys[0, n) and stores the results of searching for them in results.
+// Runs up to BTREE_BATCH_WIDTH lookups as a round robin of state machines.
+// A lookup's state is just its key and the node it has to search next.
+// Each turn searches that node, then either finishes the lookup, starting the
+// next key in its slot, or moves to a child and prefetches it before yielding.
+// By the time the round comes back to it, the child should be in cache.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::findBatch(const T *keys, size_t n, pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned> *results) {
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *node[BTREE_BATCH_WIDTH];
+	size_t which[BTREE_BATCH_WIDTH];
+	size_t next = 0;
+	unsigned active = 0;
+	while (active < BTREE_BATCH_WIDTH && next < n) {
+		node[active] = root;
+		which[active] = next++;
+		active++;
+	}
+
+	while (active > 0) {
+		for (unsigned s = 0; s < active;) {
+			BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = node[s];
+			const T &k = keys[which[s]];
+			unsigned i = findIndex(x, k);
+
+			// Keep descending.
+			if (!x->leaf && !(i < x->size && !lessThan(k, x->key[i]))) {
+				node[s] = x->child[i];
+				prefetchNode(node[s]);
+				s++;
+				continue;
+			}
+
+			// Found it, or hit the bottom of the tree.
+			if (i < x->size && !lessThan(k, x->key[i])) {
+				results[which[s]] = pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned>(x, i);
+			}
+			else {
+				results[which[s]] = pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned>(NULL, 0);
+			}
+
+			// Start the next key in this slot, or close the slot
+			// by moving the last active lookup into it.
+			if (next < n) {
+				node[s] = root;
+				which[s] = next++;
+				s++;
+			}
+			else {
+				active--;
+				node[s] = node[active];
+				which[s] = which[active];
+			}
+		}
+	}
+}
+
+
+// Removes every key k with lo <= k < hi.
+// Returns the number of keys removed.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+size_t BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::eraseRange(const T &lo, const T &hi) {
+	static_assert(is_void<Mapped>::value, "eraseRange only erases keys");
+	if (!lessThan(lo, hi)) {
+		return 0;
+	}
+	EraseRange range = {&lo, &hi, false};
+	size_t erased = eraseRuns(root, &range, &range + 1);
+	shrinkRoot();
+	return erased;
+}
+
+
+// Removes every key equivalent to a key in [first, last).
+// Each batch key becomes a closed range of its own, so runs of
+// equal keys in the tree go with it.
+// Returns the number of keys removed.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+template <typename InputIt>
+size_t BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::eraseBatch(InputIt first, InputIt last) {
+	static_assert(is_void<Mapped>::value, "eraseBatch only erases keys");
+	vector<T> keys(first, last);
+	sort(keys.begin(), keys.end(), lessThan);
+	vector<EraseRange> ranges;
+	ranges.reserve(keys.size());
+	for (size_t i = 0; i < keys.size(); i++) {
+		if (ranges.empty() || lessThan(*ranges.back().lo, keys[i])) {
+			EraseRange range = {&keys[i], &keys[i], true};
+			ranges.push_back(range);
+		}
+	}
+	if (ranges.empty()) {
+		return 0;
+	}
+	size_t erased = eraseRuns(root, ranges.data(), ranges.data() + ranges.size());
+	shrinkRoot();
+	return erased;
+}
+
+
+// Returns a copy of the key equivalent to k, or nothing if there is none.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+optional<T> BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::find(const T &k) {
+	pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned> node = search(k);
+	if (node.first == NULL) {
+		return nullopt;
+	}
+	return node.first->key[node.second];
+}
+
+
+// Returns whether a key equivalent to k is in the tree.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+bool BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::contains(const T &k) {
+	return search(k).first != NULL;
+}
+
+
+// Replaces the keys in the tree with the sorted keys in [first, last).
+// The keys are dealt out to leaves left to right, with one key held back
+// between each pair of leaves to separate them. The held back keys are then
+// dealt out the same way to the level above, until a level fits in one node.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+template <typename InputIt>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::bulkLoad(InputIt first, InputIt last, double fillFactor) {
+
+	// The key count is needed up front, so single-pass ranges are buffered first.
+	if constexpr (!is_base_of<forward_iterator_tag, typename iterator_traits<InputIt>::iterator_category>::value) {
+		vector<T> keys(first, last);
+		bulkLoad(make_move_iterator(keys.begin()), make_move_iterator(keys.end()), fillFactor);
+	}
+	else {
+		freeAll();
+
+		fillFactor = fillFactor < 0 ? 0 : fillFactor > 1 ? 1 : fillFactor;
+		size_t target = (size_t) (fillFactor * (2 * degree() - 1) + 0.5);
+		size_t n = distance(first, last);
+
+		// Build the leaves straight from the range.
+		size_t groups = bulkGroups(n, target);
+		vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> nodes;
+		vector<T> separators;
+		nodes.reserve(groups);
+		separators.reserve(groups - 1);
+		for (size_t i = 0; i < groups; i++) {
+			BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = newNode();
+			x->leaf = true;
+			x->size = (n - groups + 1) / groups + (i < (n - groups + 1) % groups);
+			for (unsigned j = 0; j < x->size; j++, ++first) {
+				x->key[j] = *first;
+			}
+			refreshNode(x);
+			nodes.push_back(x);
+			if (i + 1 < groups) {
+				separators.push_back(*first);
+				++first;
+			}
+		}
+
+		// Build inner levels from the separators of the level below.
+		while (nodes.size() > 1) {
+			n = separators.size();
+			groups = bulkGroups(n, target);
+			vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> parents;
+			vector<T> parentSeparators;
+			parents.reserve(groups);
+			parentSeparators.reserve(groups - 1);
+			size_t next = 0;
+			for (size_t i = 0; i < groups; i++) {
+				BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = newNode();
+				x->leaf = false;
+				x->size = (n - groups + 1) / groups + (i < (n - groups + 1) % groups);
+				for (unsigned j = 0; j < x->size; j++, next++) {
+					x->key[j] = std::move(separators[next]);
+					x->child[j] = nodes[next];
+				}
+				x->child[x->size] = nodes[next];
+				refreshNode(x);
+				parents.push_back(x);
+				if (i + 1 < groups) {
+					parentSeparators.push_back(std::move(separators[next]));
+					next++;
+				}
+			}
+			nodes.swap(parents);
+			separators.swap(parentSeparators);
+		}
+
+		root = nodes[0];
+	}
+}
+
+
+// Replaces the keys in the tree with the keys in [first, last) using a pool of threads.
+// Ranges that aren't sorted or random access are copied into a buffer first.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+template <typename InputIt>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::parallelBulkLoad(InputIt first, InputIt last, double fillFactor, unsigned threads, bool sorted) {
+	ThreadPool workers(threads);
+	if constexpr (is_base_of<random_access_iterator_tag, typename iterator_traits<InputIt>::iterator_category>::value) {
+		if (sorted) {
+			parallelBuild(first, last - first, fillFactor, workers);
+			return;
+		}
+	}
+
+	vector<T> keys;
+	if constexpr (is_base_of<random_access_iterator_tag, typename iterator_traits<InputIt>::iterator_category>::value) {
+		keys.resize(last - first);
+		workers.parallelFor(keys.size(), 1 << 14, [&](size_t begin, size_t end) {
+			copy(first + begin, first + end, keys.begin() + begin);
+		});
+	}
+	else {
+		keys.assign(first, last);
+	}
+	if (!sorted) {
+		parallelSort(keys, workers);
+	}
+	parallelBuild(make_move_iterator(keys.begin()), keys.size(), fillFactor, workers);
+}
+
+
+// Replaces the keys in the tree with the n sorted keys starting at first.
+// Each level is built like bulkLoad does, but since a node's keys start at an offset
+// that only depends on its index, the nodes of a level can be filled independently.
+// The levels near the top are too small to split, so this thread fills them.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+template <typename RandomIt>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::parallelBuild(RandomIt first, size_t n, double fillFactor, ThreadPool &workers) {
+	freeAll();
+
+	fillFactor = fillFactor < 0 ? 0 : fillFactor > 1 ? 1 : fillFactor;
+	size_t target = (size_t) (fillFactor * (2 * degree() - 1) + 0.5);
+
+	vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> nodes(bulkGroups(n, target));
+	vector<T> separators;
+	fillLevel(nodes, first, n, (BNode<T, Degree, Mapped, Counted, Monoid, Latched>**) NULL, separators, workers);
+
+	while (nodes.size() > 1) {
+		vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> children;
+		vector<T> keys;
+		children.swap(nodes);
+		keys.swap(separators);
+		nodes.resize(bulkGroups(keys.size(), target));
+		fillLevel(nodes, make_move_iterator(keys.begin()), keys.size(), children.data(), separators, workers);
+	}
+
+	root = nodes[0];
+}
+
+
+// Fills the nodes of a level from the n sorted keys starting at first.
+// Node i gets the keys from offset i * (base + 1) + min(i, extra),
+// and the key after its last one becomes separator i for the level above.
+// Nodes are allocated up front by this thread, then filled in parallel.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+template <typename RandomIt>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::fillLevel(vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> &nodes, RandomIt first, size_t n, BNode<T, Degree, Mapped, Counted, Monoid, Latched> **children, vector<T> &separators, ThreadPool &workers) {
+	size_t groups = nodes.size();
+	size_t base = (n - groups + 1) / groups;
+	size_t extra = (n - groups + 1) % groups;
+	for (size_t i = 0; i < groups; i++) {
+		nodes[i] = newNode();
+		nodes[i]->leaf = children == NULL;
+	}
+	separators.resize(groups - 1);
+
+	workers.parallelFor(groups, (1 << 12) / (base + 1) + 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = nodes[i];
+			size_t offset = i * (base + 1) + (i < extra ? i : extra);
+			x->size = base + (i < extra);
+			for (unsigned j = 0; j < x->size; j++) {
+				x->key[j] = first[offset + j];
+			}
+			if (children != NULL) {
+				for (unsigned j = 0; j <= x->size; j++) {
+					x->child[j] = children[offset + j];
+				}
+			}
+			refreshNode(x);
+			if (i + 1 < groups) {
+				separators[i] = first[offset + x->size];
+			}
+		}
+	});
+}
+
+
+// Sorts keys with the tree's comparison functor.
+// Each thread sorts a chunk, then neighbouring chunks are merged in parallel
+// until one is left.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::parallelSort(vector<T> &keys, ThreadPool &workers) {
+	size_t chunks = workers.size();
+	size_t n = keys.size();
+	if (chunks <= 1 || n < (1 << 14)) {
+		sort(keys.begin(), keys.end(), lessThan);
+		return;
+	}
+	workers.run(chunks, [&](size_t i) {
+		sort(keys.begin() + n * i / chunks, keys.begin() + n * (i + 1) / chunks, lessThan);
+	});
+	for (size_t width = 1; width < chunks; width *= 2) {
+		workers.run((chunks + 2 * width - 1) / (2 * width), [&](size_t i) {
+			size_t lo = 2 * width * i;
+			size_t mid = lo + width < chunks ? lo + width : chunks;
+			size_t hi = lo + 2 * width < chunks ? lo + 2 * width : chunks;
+			inplace_merge(keys.begin() + n * lo / chunks, keys.begin() + n * mid / chunks, keys.begin() + n * hi / chunks, lessThan);
+		});
+	}
+}
+
+
+// Counts the keys less than k.
+// Every key and whole child to the left of the search path is less than k,
+// so the counts of those children are added up on the way down.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+size_t BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::rank(const T &k) {
+	static_assert(Counted, "rank needs a tree with Counted set");
+	size_t less = 0;
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = root;
+	while (true) {
+		unsigned i = findIndex(x, k);
+		less += i;
+		if (x->leaf) {
+			return less;
+		}
+		prefetchNode(x->child[i]);
+		for (unsigned j = 0; j < i; j++) {
+			less += x->child[j]->count;
+		}
+		x = x->child[i];
+	}
+}
+
+
+// Finds the key with i keys before it.
+// Walks each node's children left to right, skipping the ones that hold fewer than i keys.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+const T &BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::select(size_t i) {
+	static_assert(Counted, "select needs a tree with Counted set");
+	if (i >= root->count) {
+		throw (BTREE_EXCEPTION) SELECT_OUT_OF_RANGE;
+	}
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = root;
+	while (!x->leaf) {
+		unsigned j = 0;
+		while (i >= x->child[j]->count) {
+			i -= x->child[j]->count;
+			if (i == 0) {
+				return x->key[j];
+			}
+			i--;
+			j++;
+		}
+		x = x->child[j];
+	}
+	return x->key[i];
+}
+
+
+// Counts the keys k with lo <= k < hi.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+size_t BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::countRange(const T &lo, const T &hi) {
+	static_assert(Counted, "countRange needs a tree with Counted set");
+	if (!lessThan(lo, hi)) {
+		return 0;
+	}
+	return rank(hi) - rank(lo);
+}
+
+
+// Combines the keys k with lo <= k < hi.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+typename BNodeAggregate<Monoid>::value_type BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::aggregate(const T &lo, const T &hi) {
+	static_assert(!is_void<Monoid>::value, "aggregate needs a tree with a Monoid");
+	if (!lessThan(lo, hi)) {
+		return Monoid::identity();
+	}
+	return aggregateNode(root, &lo, &hi);
+}
+
+
+// Iterator to the smallest key in the tree.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::begin() {
+	const_iterator it(root);
+	if (root->size != 0) {
+		it.descendLeft(root);
+	}
+	return it;
+}
+
+
+// Iterator past the largest key in the tree.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::end() {
+	return const_iterator(root);
+}
+
+
+// Iterator to the first key that is not less than k.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::lower_bound(const T &k) {
+	return bound<false>(k);
+}
+
+
+// Iterator to the first key that is greater than k.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::upper_bound(const T &k) {
+	return bound<true>(k);
+}
+
+
+// The keys equivalent to k.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+pair<typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator, typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator>
+BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::equal_range(const T &k) {
+	return make_pair(lower_bound(k), upper_bound(k));
+}
+
+
+// Finds the first key that is not less than k, or that is greater than k if Upper is true.
+// The answer is either in the leaf reached by following the search down,
+// or is the key after the deepest child on the path that isn't the last child of its node.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+template <bool Upper>
+typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::bound(const T &k) {
+	const_iterator it(root);
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = root;
+	while (true) {
+		unsigned i = Upper ? findUpperIndex(x, k) : findIndex(x, k);
+		if (!x->leaf) {
+			prefetchNode(x->child[i]);
+		}
+		it.path[it.depth] = x;
+		it.index[it.depth] = i;
+		it.depth++;
+		if (x->leaf) {
+			if (i == x->size) {
+				it.ascend();
+			}
+			return it;
+		}
+		x = x->child[i];
+	}
+}
+
+
 // Function for printing a tree.
-template <typename T>
-void BTree<T>::print() {
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::print() {
 	if (printKey != NULL && root != NULL) {
 		printf("\n");
 		printNode(root, 0);
@@ -210,143 +922,735 @@ void BTree<T>::print() {
 }
 
 
-// Initialize a b tree node.
-// x is a pointer to the node
-// t is the minimum degree of the tree.
-template <typename T>
-void BTree<T>::initializeNode(BNode<T> *x) {
-	x->size = 0;
-	x->key = (T*) malloc((2 * minDegree - 1) * sizeof(T));
-	x->child = (BNode<T>**) malloc(2 * minDegree * sizeof(BNode<T>*));
+// Returns the minimum degree of the tree.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+inline unsigned BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::degree() const {
+	return Degree == DYNAMIC_DEGREE ? minDegree : Degree;
 }
 
 
-// Recursively deletes the subtree rooted at x.
-// Does the dirty work for the destructor.
-template <typename T>
-void BTree<T>::freeNode(BNode<T> *x) {
+// Inserts the sorted keys in [first, last) into the subtree rooted at x.
+// Equal keys go after the ones already in the tree, as with insert.
+// When x is too small to hold everything, its keys (and children) are flattened
+// into one run with the new keys or split children, and then repartitioned
+// into the nodes returned in nodes, starting with x. nodes is left empty if x didn't split.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::insertRun(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, T *first, T *last,
+		vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> &nodes, vector<T> &separators) {
+	size_t n = last - first;
+	vector<T> keys;
+	vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> children;
+
+	if (x->leaf) {
+
+		// Merge in place from the back if everything fits.
+		if (x->size + n <= 2 * degree() - 1) {
+			unsigned i = x->size;
+			unsigned dest = x->size + n;
+			while (last != first) {
+				if (i > 0 && lessThan(*(last - 1), x->key[i - 1])) {
+					x->key[--dest] = std::move(x->key[--i]);
+				}
+				else {
+					x->key[--dest] = std::move(*--last);
+				}
+			}
+			x->size += n;
+			refreshNode(x);
+			return;
+		}
+
+		keys.reserve(x->size + n);
+		unsigned i = 0;
+		while (i < x->size || first != last) {
+			if (first == last || (i < x->size && !lessThan(*first, x->key[i]))) {
+				keys.push_back(std::move(x->key[i++]));
+			}
+			else {
+				keys.push_back(std::move(*first++));
+			}
+		}
+		nodes.assign(1, x);
+		repartition(keys, children, nodes, separators);
+		return;
+	}
+
+	// Hand each child that gets keys its run of them. Children that split are spliced
+	// into a flattened copy of x, which is only started once the first child splits.
+	// The copy holds x's children and keys up to but not including index copied.
+	unsigned copied = 0;
+	vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> split;
+	vector<T> splitSeparators;
+	while (first != last) {
+		unsigned j = findUpperIndex(x, *first);
+		T *end = j < x->size ? std::lower_bound(first, last, x->key[j], lessThan) : last;
+		insertRun(x->child[j], first, end, split, splitSeparators);
+		first = end;
+
+		if (!split.empty()) {
+			for (; copied < j; copied++) {
+				children.push_back(x->child[copied]);
+				keys.push_back(std::move(x->key[copied]));
+			}
+			children.push_back(split[0]);
+			for (unsigned i = 0; i < splitSeparators.size(); i++) {
+				keys.push_back(std::move(splitSeparators[i]));
+				children.push_back(split[i + 1]);
+			}
+			if (j < x->size) {
+				keys.push_back(std::move(x->key[j]));
+			}
+			copied = j + 1;
+			split.clear();
+			splitSeparators.clear();
+		}
+	}
+
+	if (!children.empty()) {
+		for (; copied <= x->size; copied++) {
+			children.push_back(x->child[copied]);
+			if (copied < x->size) {
+				keys.push_back(std::move(x->key[copied]));
+			}
+		}
+		if (keys.size() <= 2 * degree() - 1) {
+			x->size = keys.size();
+			for (unsigned i = 0; i < x->size; i++) {
+				x->key[i] = std::move(keys[i]);
+				x->child[i] = children[i];
+			}
+			x->child[x->size] = children[x->size];
+		}
+		else {
+			nodes.assign(1, x);
+			repartition(keys, children, nodes, separators);
+		}
+	}
+	if (nodes.empty()) {
+		refreshNode(x);
+	}
+}
+
+
+// Erases the keys in the sorted, disjoint ranges [first, last) from the subtree rooted at x.
+// Children lying wholly inside a range are freed without being searched,
+// and only children holding a range's end are recursed into.
+// Afterwards every node below x is within t - 1 and 2t - 1 keys again,
+// but x itself may be left with fewer. If it has no keys at all,
+// the same goes for its single child.
+// Returns the number of keys erased.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+size_t BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::eraseRuns(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, const EraseRange *first, const EraseRange *last) {
+
+	// Keys [low[r], high[r]) of x are inside range r.
+	size_t n = last - first;
+	vector<unsigned> low(n);
+	vector<unsigned> high(n);
+	size_t erased = 0;
+	for (size_t r = 0; r < n; r++) {
+		low[r] = findIndex(x, *first[r].lo);
+		high[r] = first[r].closed ? findUpperIndex(x, *first[r].hi) : findIndex(x, *first[r].hi);
+		erased += high[r] - low[r];
+	}
+
+	if (x->leaf) {
+		unsigned kept = low[0];
+		for (size_t r = 0; r < n; r++) {
+			unsigned end = r + 1 < n ? low[r + 1] : x->size;
+			for (unsigned i = high[r]; i < end; i++, kept++) {
+				if (kept != i) {
+					x->key[kept] = std::move(x->key[i]);
+				}
+			}
+		}
+		x->size = kept;
+		refreshNode(x);
+		return erased;
+	}
+
+	// Child j is covered by range r if low[r] < j < high[r], and holds an end of r
+	// if j is low[r] or high[r]. Since the ranges are sorted and disjoint,
+	// the ranges holding child j are a contiguous run, and a covered child is held by no other.
+	vector<bool> covered(x->size + 1, false);
+	bool changed = erased != 0;
+	size_t r = 0;
+	for (unsigned j = 0; j <= x->size; j++) {
+		while (r < n && high[r] < j) {
+			r++;
+		}
+		size_t end = r;
+		while (end < n && low[end] <= j) {
+			end++;
+		}
+		if (end == r) {
+			continue;
+		}
+		if (low[r] < j && j < high[r]) {
+			covered[j] = true;
+			erased += freeNode(x->child[j]);
+		}
+		else {
+			erased += eraseRuns(x->child[j], first + r, first + end);
+			changed = changed || x->child[j]->size < degree() - 1;
+		}
+	}
+	if (!changed) {
+		refreshNode(x);
+		return erased;
+	}
+
+	// Flatten what is left of x. Kept children that end up next to each other,
+	// with all the keys between them erased, are concatenated.
+	vector<T> keys;
+	vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> children;
+	vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> seam;
+	vector<T> seamSeparators;
+	bool needsKey = false;
+	r = 0;
+	for (unsigned j = 0; j <= x->size; j++) {
+		if (!covered[j]) {
+			if (needsKey) {
+				BNode<T, Degree, Mapped, Counted, Monoid, Latched> *left = children.back();
+				children.pop_back();
+				concatNodes(left, x->child[j], seam, seamSeparators);
+				children.push_back(seam[0]);
+				for (unsigned i = 0; i < seamSeparators.size(); i++) {
+					keys.push_back(std::move(seamSeparators[i]));
+					children.push_back(seam[i + 1]);
+				}
+			}
+			else {
+				children.push_back(x->child[j]);
+			}
+			needsKey = true;
+		}
+		if (j < x->size) {
+			while (r < n && high[r] <= j) {
+				r++;
+			}
+			if (r == n || j < low[r]) {
+				keys.push_back(std::move(x->key[j]));
+				needsKey = false;
+			}
+		}
+	}
+	mergeUnderfull(keys, children);
+
+	x->size = keys.size();
+	for (unsigned i = 0; i < x->size; i++) {
+		x->key[i] = std::move(keys[i]);
+		x->child[i] = children[i];
+	}
+	x->child[x->size] = children[x->size];
+	refreshNode(x);
+	return erased;
+}
+
+
+// Joins two subtrees of the same height, where every key of a comes before every key of b,
+// into the nodes put in nodes, separated by the keys put in separators.
+// The last child of a and first child of b are joined the same way first,
+// which zips the two subtrees together down the seam between them.
+// The result is one or two nodes. A single node may have fewer than t - 1 keys,
+// and if it has none, its child may too.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::concatNodes(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *a, BNode<T, Degree, Mapped, Counted, Monoid, Latched> *b,
+		vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> &nodes, vector<T> &separators) {
+	vector<T> keys;
+	vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> children;
+	if (a->leaf) {
+		flattenNode(a, keys, children);
+		flattenNode(b, keys, children);
+	}
+	else {
+		vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> seam;
+		vector<T> seamSeparators;
+		concatNodes(a->child[a->size], b->child[0], seam, seamSeparators);
+		for (unsigned i = 0; i < a->size; i++) {
+			children.push_back(a->child[i]);
+			keys.push_back(std::move(a->key[i]));
+		}
+		children.push_back(seam[0]);
+		for (unsigned i = 0; i < seamSeparators.size(); i++) {
+			keys.push_back(std::move(seamSeparators[i]));
+			children.push_back(seam[i + 1]);
+		}
+		for (unsigned i = 0; i < b->size; i++) {
+			keys.push_back(std::move(b->key[i]));
+			children.push_back(b->child[i + 1]);
+		}
+		mergeUnderfull(keys, children);
+	}
+	nodes.clear();
+	nodes.push_back(a);
+	nodes.push_back(b);
+	repartition(keys, children, nodes, separators);
+}
+
+
+// Merges each child in a flattened run that has fewer than t - 1 keys
+// with a neighbour and the key between them, then repartitions the pair.
+// A pair of small children can make another small child, so that is merged again.
+// A child with no keys may have a small child of its own. Flattening the pair
+// puts that grandchild next to the neighbour's children, where it is merged in turn.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::mergeUnderfull(vector<T> &keys, vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> &children) {
+	vector<T> pairKeys;
+	vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> pairChildren;
+	vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> pair;
+	vector<T> pairSeparators;
+	size_t i = 0;
+	while (i < children.size()) {
+		if (children[i]->size >= degree() - 1 || children.size() == 1) {
+			i++;
+			continue;
+		}
+		size_t l = i + 1 < children.size() ? i : i - 1;
+		pairKeys.clear();
+		pairChildren.clear();
+		flattenNode(children[l], pairKeys, pairChildren);
+		pairKeys.push_back(std::move(keys[l]));
+		flattenNode(children[l + 1], pairKeys, pairChildren);
+		mergeUnderfull(pairKeys, pairChildren);
+		pair.assign(children.begin() + l, children.begin() + l + 2);
+		repartition(pairKeys, pairChildren, pair, pairSeparators);
+
+		children.erase(children.begin() + l, children.begin() + l + 2);
+		children.insert(children.begin() + l, pair.begin(), pair.end());
+		keys.erase(keys.begin() + l);
+		keys.insert(keys.begin() + l, make_move_iterator(pairSeparators.begin()), make_move_iterator(pairSeparators.end()));
+		i = l;
+	}
+}
+
+
+// Moves the keys of x, and its children if it has any, onto the ends of keys and children.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::flattenNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, vector<T> &keys, vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> &children) {
+	for (unsigned i = 0; i < x->size; i++) {
+		keys.push_back(std::move(x->key[i]));
+	}
 	if (!x->leaf) {
-		for (unsigned i = 0; i <= x->size; i++) {
-			freeNode(x->child[i]);
+		children.insert(children.end(), &x->child[0], &x->child[0] + x->size + 1);
+	}
+}
+
+
+// Replaces the root with its only child while it has no keys.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::shrinkRoot() {
+	while (!root->leaf && root->size == 0) {
+		BNode<T, Degree, Mapped, Counted, Monoid, Latched> *oldRoot = root;
+		root = root->child[0];
+		deleteNode(oldRoot);
+	}
+}
+
+
+// Rebuilds a flattened run into nodes, reusing the ones given.
+// A leaf run has no children. Otherwise children has one more entry than keys.
+// Groups are made as full as possible, so a node that overflows by one key
+// splits in two like splitChild does, and a larger overflow splits into just enough nodes.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::repartition(vector<T> &keys, vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> &children,
+		vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> &nodes, vector<T> &separators) {
+	size_t n = keys.size();
+	size_t groups = bulkGroups(n, 2 * degree() - 1);
+	while (nodes.size() > groups) {
+		deleteNode(nodes.back());
+		nodes.pop_back();
+	}
+	while (nodes.size() < groups) {
+		nodes.push_back(newNode());
+	}
+
+	separators.clear();
+	size_t next = 0;
+	for (size_t i = 0; i < groups; i++) {
+		BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = nodes[i];
+		x->leaf = children.empty();
+		x->size = (n - groups + 1) / groups + (i < (n - groups + 1) % groups);
+		for (unsigned j = 0; j < x->size; j++, next++) {
+			x->key[j] = std::move(keys[next]);
+			if (!x->leaf) {
+				x->child[j] = children[next];
+			}
+		}
+		if (!x->leaf) {
+			x->child[x->size] = children[next];
+		}
+		refreshNode(x);
+		if (i + 1 < groups) {
+			separators.push_back(std::move(keys[next++]));
+		}
+	}
+}
+
+
+// Number of nodes to split n keys into, with the keys between nodes moving up a level.
+// Aims for target keys per node, but keeps the count where every node
+// gets between t - 1 and 2t - 1 keys: from (n + 1) / 2t up to (n + 1) / t.
+// Always at least 1, so a small level becomes a root of any size.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+size_t BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::bulkGroups(size_t n, size_t target) {
+	size_t groups = (n + 1 + target) / (target + 1);
+	size_t most = (n + 1) / degree();
+	size_t fewest = (n + 2 * degree()) / (2 * degree());
+	groups = groups > most ? most : groups;
+	groups = groups < fewest ? fewest : groups;
+	return groups;
+}
+
+
+// Allocates a b tree node.
+// The header, keys, and children share one cache-line-aligned block from the tree's pool,
+// so visiting a node does not chase pointers into other heap lines.
+// Every key slot is default constructed, so keys are only ever moved between live objects.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+BNode<T, Degree, Mapped, Counted, Monoid, Latched> *BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::newNode() {
+	char *block = (char*) pool.allocate();
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = new (block) BNode<T, Degree, Mapped, Counted, Monoid, Latched>;
+	if constexpr (Degree == DYNAMIC_DEGREE) {
+		x->key = (T*) (block + keyOffset);
+		x->child = (BNode<T, Degree, Mapped, Counted, Monoid, Latched>**) (block + childOffset);
+		uninitialized_default_construct_n(x->key, 2 * degree() - 1);
+		if constexpr (!is_void<Mapped>::value) {
+			x->value = (Mapped*) (block + valueOffset);
+			uninitialized_default_construct_n(x->value, 2 * degree() - 1);
+		}
+	}
+	x->size = 0;
+	if constexpr (Counted) {
+		x->count = 0;
+	}
+	if constexpr (!is_void<Monoid>::value) {
+		x->aggregate = Monoid::identity();
+	}
+	return x;
+}
+
+
+// Destroys the keys of x and returns its block to the pool.
+// If retireNode is set, it decides when that happens instead.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::deleteNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x) {
+	if (retireNode != NULL) {
+		retireNode(retireContext, x);
+		return;
+	}
+	destroyNode(x);
+	pool.deallocate(x);
+}
+
+
+// Destroys the keys, and values if any, of x, leaving its block allocated.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::destroyNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x) {
+	if constexpr (Degree == DYNAMIC_DEGREE) {
+		destroy_n(x->key, 2 * degree() - 1);
+		if constexpr (!is_void<Mapped>::value) {
+			destroy_n(x->value, 2 * degree() - 1);
+		}
+	}
+	x->~BNode<T, Degree, Mapped, Counted, Monoid, Latched>();
+}
+
+
+// Deletes the subtree rooted at x, returning its blocks to the pool.
+// Walks the subtree with an explicit stack rather than recursion,
+// so the call stack stays flat however deep the tree is.
+// Returns the number of keys that were in the subtree.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+size_t BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::freeNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x) {
+	size_t keys = 0;
+	vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> stack(1, x);
+	while (!stack.empty()) {
+		x = stack.back();
+		stack.pop_back();
+		if (!x->leaf) {
+			stack.insert(stack.end(), &x->child[0], &x->child[0] + x->size + 1);
+		}
+		keys += x->size;
+		deleteNode(x);
+	}
+	return keys;
+}
+
+
+// Deletes every node in the tree and releases the pool's slabs, leaving root dangling.
+// When the nodes have nothing to destroy, none of them are visited at all,
+// so this takes time in the number of slabs instead of the number of nodes.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::freeAll() {
+	if constexpr (!is_trivially_destructible<BNode<T, Degree, Mapped, Counted, Monoid, Latched>>::value || !is_trivially_destructible<T>::value
+			|| !(is_void<Mapped>::value || is_trivially_destructible<Mapped>::value)) {
+		vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*> stack(1, root);
+		while (!stack.empty()) {
+			BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = stack.back();
+			stack.pop_back();
+			if (!x->leaf) {
+				stack.insert(stack.end(), &x->child[0], &x->child[0] + x->size + 1);
+			}
+			destroyNode(x);
+		}
+	}
+	pool.release();
+}
+
+
+// Sets x's count to its own keys plus the counts of its children,
+// and its aggregate to the combination of its keys and its children's aggregates in order.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+inline void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::refreshNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x) {
+	if constexpr (Counted) {
+		x->count = x->size;
+		if (!x->leaf) {
+			for (unsigned i = 0; i <= x->size; i++) {
+				x->count += x->child[i]->count;
+			}
+		}
+	}
+	if constexpr (!is_void<Monoid>::value) {
+		typename Monoid::value_type total = x->leaf ? Monoid::identity() : x->child[0]->aggregate;
+		for (unsigned i = 0; i < x->size; i++) {
+			total = Monoid::combine(total, Monoid::lift(x->key[i]));
+			if (!x->leaf) {
+				total = Monoid::combine(total, x->child[i + 1]->aggregate);
+			}
 		}
+		x->aggregate = std::move(total);
 	}
-	free(x->child);
-	free(x->key);
-	free(x);
+	(void) x;
+}
+
+
+// Updates path[0, n) after delta keys were added to the subtree under path[n - 1].
+// Counts are adjusted by delta, but aggregates can't be adjusted by a difference,
+// so with a Monoid each node is refreshed from the bottom of the path up.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+inline void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::refreshPath(BNode<T, Degree, Mapped, Counted, Monoid, Latched> **path, unsigned n, long delta) {
+	if constexpr (!is_void<Monoid>::value) {
+		for (unsigned i = n; i-- > 0;) {
+			refreshNode(path[i]);
+		}
+	}
+	else if constexpr (Counted) {
+		for (unsigned i = 0; i < n; i++) {
+			path[i]->count += delta;
+		}
+	}
+	(void) path;
+	(void) n;
+	(void) delta;
+}
+
+
+// Combines the keys k in the subtree under x with *lo <= k < *hi.
+// Keys [a, b) of x are in the range, and so are the whole subtrees between them.
+// Only the children holding a bound are descended into, and below the node
+// where the bounds split up each of those has one bound left open.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+typename BNodeAggregate<Monoid>::value_type BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::aggregateNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, const T *lo, const T *hi) {
+	if (lo == NULL && hi == NULL) {
+		return x->aggregate;
+	}
+	unsigned a = lo == NULL ? 0 : findIndex(x, *lo);
+	unsigned b = hi == NULL ? x->size : findIndex(x, *hi);
+
+	// Both bounds fall in the same child.
+	if (a == b) {
+		return x->leaf ? Monoid::identity() : aggregateNode(x->child[a], lo, hi);
+	}
+
+	typename Monoid::value_type total = x->leaf ? Monoid::identity() : aggregateNode(x->child[a], lo, NULL);
+	for (unsigned i = a; i < b; i++) {
+		total = Monoid::combine(total, Monoid::lift(x->key[i]));
+		if (!x->leaf) {
+			total = Monoid::combine(total, i + 1 == b ? aggregateNode(x->child[b], NULL, hi) : x->child[i + 1]->aggregate);
+		}
+	}
+	return total;
+}
+
+
+// Starts loading x into cache, ahead of searching it.
+// With BTREE_PREFETCH 1, that's the header and every line of the key array,
+// so a binary search over a multi-line node doesn't wait on one miss after another.
+// With BTREE_PREFETCH 2, the child pointers and values are loaded too.
+// Only computes addresses within x, so it doesn't wait for x itself.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+inline void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::prefetchNode(const BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x) const {
+#if BTREE_PREFETCH > 0 && defined(__GNUC__)
+	const char *first;
+	const char *last;
+	if (BTREE_PREFETCH >= 2) {
+		first = (const char*) x;
+		last = first + nodeSize;
+	}
+	else if constexpr (Degree == DYNAMIC_DEGREE) {
+		first = (const char*) x;
+		last = first + keyOffset + (2 * degree() - 1) * sizeof(T);
+	}
+	else {
+		__builtin_prefetch(&x->size);
+		first = (const char*) &x->key;
+		last = first + sizeof(x->key);
+	}
+	for (const char *line = first; line < last; line += CACHE_LINE_SIZE) {
+		__builtin_prefetch(line);
+	}
+#else
+	(void) x;
+#endif
 }
 
 
 // Finds the index of k in x->key.
 // If k is not present, returns the index of the subtree
 // that could contain k in x->child.
-template <typename T>
-unsigned BTree<T>::findIndex(BNode<T> *x, T k) {
-	unsigned i = 0;
-	while (i < x->size && lessThan(x->key[i], k)) {
-		i++;
-	}
-	return i;
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+inline unsigned BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::findIndex(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, const T &k) {
+	return searchKeys<false>(&x->key[0], x->size, k, lessThan);
+}
+
+
+// Finds the index of the first key in x->key that is greater than k.
+// This is where k goes when it is inserted after any equivalent keys.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+inline unsigned BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::findUpperIndex(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, const T &k) {
+	return searchKeys<true>(&x->key[0], x->size, k, lessThan);
 }
 
 
 // Inserts k into x.
 // Returns the index of k in x->key.
-template <typename T>
-unsigned BTree<T>::nodeInsert(BNode<T> *x, T k) {
-	int index;
-
-	// Make room for k.
-	for (index = x->size; index > 0 && lessThan(k, x->key[index - 1]); index--) {
-		x->key[index] = x->key[index - 1];
-		x->child[index + 1] = x->child[index];
-	}
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+unsigned BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::nodeInsert(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, T &&k) {
+	unsigned index = findUpperIndex(x, k);
+	nodeInsertAt(x, index, std::move(k));
+	return index;
+}
 
-	// Insert k.
-	x->child[index + 1] = x->child[index];
-	x->key[index] = k;
-	x->size++;
 
-	return index;
+// Inserts k into x->key at index.
+// x->child[index + 1] is left as a copy of x->child[index] for the caller to fill in.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::nodeInsertAt(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, unsigned index, T &&k) {
+	nodeOpen(x, index);
+	x->key[index] = std::move(k);
 }
 
 
 // Deletes the indexth element from x->key.
 // Returns deleted key.
-template <typename T>
-T BTree<T>::nodeDelete(BNode<T> *x, unsigned index) {
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+T BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::nodeDelete(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, unsigned index) {
+	T toReturn = std::move(x->key[index]);
+	nodeClose(x, index);
+	return toReturn;
+}
 
-	T toReturn = x->key[index];
 
+// Shifts the keys at and after index, and the children after it, one slot to the right.
+// x->child[index + 1] is left as a copy of x->child[index] for the caller to fill in.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::nodeOpen(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, unsigned index) {
+	for (unsigned j = x->size; j > index; j--) {
+		moveEntry(x, j, x, j - 1);
+		x->child[j + 1] = x->child[j];
+	}
+	x->child[index + 1] = x->child[index];
+	x->size++;
+}
+
+
+// Shifts the keys after index, and the children after index + 1, one slot to the left.
+// The key at index and the child at index + 1 are overwritten.
+// The value left in the vacated last slot is reset, so whatever it holds is let go now.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::nodeClose(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, unsigned index) {
 	x->size--;
 	while (index < x->size) {
-		x->key[index] = x->key[index + 1];
+		moveEntry(x, index, x, index + 1);
 		x->child[index + 1] = x->child[index + 2];
 		index++;
 	}
-	return toReturn;
+	if constexpr (!is_void<Mapped>::value) {
+		x->value[x->size] = Mapped();
+	}
+}
+
+
+// Moves the key at src->key[si], and its value if the tree has values, into dst->key[di].
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+inline void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::moveEntry(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *dst, unsigned di, BNode<T, Degree, Mapped, Counted, Monoid, Latched> *src, unsigned si) {
+	dst->key[di] = std::move(src->key[si]);
+	if constexpr (!is_void<Mapped>::value) {
+		dst->value[di] = std::move(src->value[si]);
+	}
 }
 
 
 // Function for splitting nodes that are too full.
 // x points to the parent of the node to splits.
 // i is the index in x's child array of the node to split.
-template <typename T>
-void BTree<T>::splitChild(BNode<T> *x, int i) {
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::splitChild(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x, int i) {
 
 	// z is the new node and y is the node to split.
-	BNode<T> *toSplit = x->child[i];
-	BNode<T>* newNode = (BNode<T>*) malloc(sizeof(BNode<T>));;
-	initializeNode(newNode);
-	newNode->leaf = toSplit->leaf;
-	newNode->size = minDegree - 1;
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *toSplit = x->child[i];
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *sibling = newNode();
+	sibling->leaf = toSplit->leaf;
+	sibling->size = degree() - 1;
 
 	// Copy the second half of y's keys and children into z.
-	for (unsigned j = 0; j < minDegree - 1; j++) {
-		newNode->key[j] = toSplit->key[j + minDegree];
+	for (unsigned j = 0; j < degree() - 1; j++) {
+		moveEntry(sibling, j, toSplit, j + degree());
 	}
 	if (!toSplit->leaf) {
-		for (unsigned j = 0; j < minDegree; j++) {
-			newNode->child[j] = toSplit->child[j + minDegree];
+		for (unsigned j = 0; j < degree(); j++) {
+			sibling->child[j] = toSplit->child[j + degree()];
 		}
 	}
-	toSplit->size = minDegree - 1;
+	toSplit->size = degree() - 1;
 
-	nodeInsert(x, toSplit->key[minDegree - 1]);
-	x->child[i + 1] = newNode;
+	nodeOpen(x, i);
+	moveEntry(x, i, toSplit, degree() - 1);
+	x->child[i + 1] = sibling;
+	refreshNode(toSplit);
+	refreshNode(sibling);
 }
 
 
 // Merges the (i + 1)th child of parent with the ith child of parent.
 // Returns an indicator of whether the change affected the root.
-template <typename T>
-char BTree<T>::mergeChildren(BNode<T> *parent, unsigned i) {
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+char BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::mergeChildren(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *parent, unsigned i) {
 
-	BNode<T> *leftKid = parent->child[i];
-	BNode<T> *rightKid = parent->child[i + 1];
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *leftKid = parent->child[i];
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *rightKid = parent->child[i + 1];
 
 	// Move item from parent to left child.
-	leftKid->key[leftKid->size] = nodeDelete(parent, i);
+	moveEntry(leftKid, leftKid->size, parent, i);
+	nodeClose(parent, i);
 	unsigned j = ++(leftKid->size);
 
 	// Move everything from rightKid into leftKid
 	for (unsigned k = 0; k < rightKid->size; k++) {
-		leftKid->key[j + k] = rightKid->key[k];
+		moveEntry(leftKid, j + k, rightKid, k);
 		leftKid->child[j + k] = rightKid->child[k];
 	}
 	leftKid->size += rightKid->size;
 	leftKid->child[leftKid->size] = rightKid->child[rightKid->size];
 
 	// Free the memory used by rightChild
-	free(rightKid->child);
-	free(rightKid->key);
-	free(rightKid);
+	deleteNode(rightKid);
+	refreshNode(leftKid);
 
 	// If parent is empty, than it must have been the root.
 	if (parent->size == 0) {
 		root = leftKid;
-		free(parent->child);
-		free(parent->key);
-		free(parent);
+		deleteNode(parent);
 		return NEW_ROOT;
 	}
 
@@ -354,39 +1658,59 @@ char BTree<T>::mergeChildren(BNode<T> *parent, unsigned i) {
 }
 
 
-// Makes sure parent->child[index] has at least minDegree items.
+// Gives parent->child[index] one more key, taken from its left sibling by way of parent.
+// The left sibling's last child moves over with it.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::rotateFromLeft(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *parent, unsigned index) {
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *kid = parent->child[index];
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *leftKid = parent->child[index - 1];
+	nodeOpen(kid, 0);
+	moveEntry(kid, 0, parent, index - 1);
+	kid->child[0] = leftKid->child[leftKid->size];
+	moveEntry(parent, index - 1, leftKid, leftKid->size - 1);
+	nodeClose(leftKid, leftKid->size - 1);
+	refreshNode(leftKid);
+	refreshNode(kid);
+}
+
+
+// Gives parent->child[index] one more key, taken from its right sibling by way of parent.
+// The right sibling's first child moves over with it.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::rotateFromRight(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *parent, unsigned index) {
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *kid = parent->child[index];
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *rightKid = parent->child[index + 1];
+	// Move parent->key[index] down into kid.
+	nodeOpen(kid, kid->size);
+	moveEntry(kid, kid->size - 1, parent, index);
+	kid->child[kid->size] = rightKid->child[0];
+	rightKid->child[0] = rightKid->child[1];
+	// Move rightKid->key[0] up into parent.
+	moveEntry(parent, index, rightKid, 0);
+	nodeClose(rightKid, 0);
+	refreshNode(rightKid);
+	refreshNode(kid);
+}
+
+
+// Makes sure parent->child[index] has at least degree() items.
 // If it doesn't, then things are changed to make sure it does.
 // Returns a code indicating what action was taken.
-template <typename T>
-char BTree<T>::fixChildSize(BNode<T> *parent, unsigned index) {
-	BNode<T> *kid = parent->child[index];
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+char BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::fixChildSize(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *parent, unsigned index) {
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *kid = parent->child[index];
 
 	// If things need fixed.
-	if (kid->size < minDegree) {
+	if (kid->size < degree()) {
 
 		// Borrow from left sibling if possible.
-		if (index != 0 && parent->child[index - 1]->size >= minDegree) {
-			BNode<T> *leftKid = parent->child[index - 1];
-
-			// When there are numerous equivalent keys,
-			// nodeInsert can insert into an index other than 0.
-			// The for loop fixed child pointers if that happens.
-			for (unsigned i = nodeInsert(kid, parent->key[index - 1]); i != 0; i--) {
-				kid->child[i] = kid->child[i - 1];
-			}
-			kid->child[0] = leftKid->child[leftKid->size];
-			parent->key[index - 1] = nodeDelete(leftKid, leftKid->size - 1);
+		if (index != 0 && parent->child[index - 1]->size >= degree()) {
+			rotateFromLeft(parent, index);
 		}
 
 		// Borrow from right sibling if possible
-		else if (index != parent->size && parent->child[index + 1]->size >= minDegree) {
-			BNode<T> *rightKid = parent->child[index + 1];
-			// Move curr->key[i] into kid->key
-			nodeInsert(kid, parent->key[index]);
-			kid->child[kid->size] = rightKid->child[0];
-			rightKid->child[0] = rightKid->child[1];
-			// Move rightKid->key[0] into curr->key
-			parent->key[index] = nodeDelete(rightKid, 0);
+		else if (index != parent->size && parent->child[index + 1]->size >= degree()) {
+			rotateFromRight(parent, index);
 		}
 
 		// If borrowing is not possible, then merge.
@@ -404,11 +1728,160 @@ char BTree<T>::fixChildSize(BNode<T> *parent, unsigned index) {
 }
 
 
+// Constructs an iterator that doesn't belong to any tree.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::const_iterator() : root(NULL), depth(0) {}
+
+
+// Constructs an end iterator for the tree rooted at r.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::const_iterator(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *r) : root(r), depth(0) {}
+
+
+// The key the iterator is at.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+const T &BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::operator*() const {
+	return path[depth - 1]->key[index[depth - 1]];
+}
+
+
+// The key the iterator is at.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+const T *BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::operator->() const {
+	return &path[depth - 1]->key[index[depth - 1]];
+}
+
+
+// Moves to the next key in order.
+// That's the leftmost key in the next child, or the next key in a leaf,
+// or the key after the nearest unfinished ancestor.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator &BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::operator++() {
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = path[depth - 1];
+	unsigned i = ++index[depth - 1];
+	if (!x->leaf) {
+		descendLeft(x->child[i]);
+	}
+	else if (i == x->size) {
+		ascend();
+	}
+	return *this;
+}
+
+
+// Moves to the next key and returns the iterator's old position.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::operator++(int) {
+	const_iterator old = *this;
+	++*this;
+	return old;
+}
+
+
+// Moves to the previous key in order.
+// That's the rightmost key in the previous child, or the previous key in a leaf,
+// or the key before the nearest ancestor that wasn't entered through its first child.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator &BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::operator--() {
+
+	// Decrementing the end iterator.
+	if (depth == 0) {
+		if (root->size != 0) {
+			descendRight(root);
+		}
+		return *this;
+	}
+
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x = path[depth - 1];
+	if (!x->leaf) {
+		descendRight(x->child[index[depth - 1]]);
+	}
+	else if (index[depth - 1] != 0) {
+		index[depth - 1]--;
+	}
+	else {
+		do {
+			depth--;
+		} while (index[depth - 1] == 0);
+		index[depth - 1]--;
+	}
+	return *this;
+}
+
+
+// Moves to the previous key and returns the iterator's old position.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+typename BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::operator--(int) {
+	const_iterator old = *this;
+	--*this;
+	return old;
+}
+
+
+// Whether two iterators are at the same key.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+bool BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::operator==(const const_iterator &other) const {
+	if (depth == 0 || other.depth == 0) {
+		return depth == other.depth;
+	}
+	return path[depth - 1] == other.path[other.depth - 1] && index[depth - 1] == other.index[other.depth - 1];
+}
+
+
+// Whether two iterators are at different keys.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+bool BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::operator!=(const const_iterator &other) const {
+	return !(*this == other);
+}
+
+
+// Pushes x and the nodes along its leftmost branch, ending at its smallest key.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::descendLeft(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x) {
+	while (true) {
+		path[depth] = x;
+		index[depth] = 0;
+		depth++;
+		if (x->leaf) {
+			return;
+		}
+		x = x->child[0];
+	}
+}
+
+
+// Pushes x and the nodes along its rightmost branch, ending at its largest key.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::descendRight(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *x) {
+	while (true) {
+		path[depth] = x;
+		depth++;
+		if (x->leaf) {
+			index[depth - 1] = x->size - 1;
+			return;
+		}
+		index[depth - 1] = x->size;
+		x = x->child[x->size];
+	}
+}
+
+
+// Pops the current node, and any ancestors entered through their last child.
+// Stops at the first ancestor with a key after the child it was entered through,
+// or at the end if there is none.
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::const_iterator::ascend() {
+	do {
+		depth--;
+	} while (depth != 0 && index[depth - 1] == path[depth - 1]->size);
+}
+
+
 // Recursize function for printing a tree or subtree.
 // node is the root of the subtree to be printed.
 // tab is how far to indent the subtree.
-template <typename T>
-void BTree<T>::printNode(BNode<T> *node, unsigned tab) {
+template <typename T, typename Compare, unsigned Degree, typename Alloc, bool Counted, typename Monoid, typename Mapped, bool Latched>
+void BTree<T, Compare, Degree, Alloc, Counted, Monoid, Mapped, Latched>::printNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched> *node, unsigned tab) {
 
 	// Indent
 	for (unsigned i = 0; i < tab; i++) {
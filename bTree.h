@@ -10,18 +10,138 @@
 
 #pragma once
 
+#include <array>
+#include <functional>
+#include <iterator>
+#include <optional>
 #include <utility>
+#include <vector>
 
+#include "nodeLatch.h"
+#include "nodePool.h"
+#include "simdSearch.h"
+#include "threadPool.h"
+
+#ifndef NULL
 #define NULL 0
+#endif
 #define SEARCH_KEY_NOT_FOUND 's'
 #define REMOVE_KEY_NOT_FOUND 'r'
+#define SELECT_OUT_OF_RANGE 'i'
+#define CACHE_LINE_SIZE 64
+#define DYNAMIC_DEGREE 0
+
+// Most levels a tree can have. Iterators keep a stack of this many nodes.
+// A tree this tall with minimum degree 2 would hold over 2^47 keys.
+#define BTREE_MAX_HEIGHT 48
+
+// Nodes holding more keys than this are searched with a binary search
+// until the remaining range is this small, and then scanned linearly.
+// Must be at least 1.
+#ifndef BTREE_BINARY_SEARCH_THRESHOLD
+#define BTREE_BINARY_SEARCH_THRESHOLD 16
+#endif
+
+// How much of the next node to prefetch once a search knows which child to visit.
+// 0 turns prefetching off.
+// 1 prefetches the node's header and keys.
+// 2 prefetches the whole node, including its child pointers and values.
+#ifndef BTREE_PREFETCH
+#define BTREE_PREFETCH 2
+#endif
+
+// Number of lookups findBatch keeps in flight at once.
+#ifndef BTREE_BATCH_WIDTH
+#define BTREE_BATCH_WIDTH 16
+#endif
+
+
+// Values stored alongside the keys of a node, for b trees that map keys to values.
+// value[i] belongs to key[i]. The values are kept out of the key array
+// so that searching a node only touches key bytes.
+// Size is the number of values, or DYNAMIC_DEGREE if they live in the node's block.
+template <typename V, unsigned Size>
+struct BNodeValues {
+	std::array<V, Size> value;	// Array of values.
+};
+
+template <typename V>
+struct BNodeValues<V, DYNAMIC_DEGREE> {
+	V *value;	// Array of values. Points into the node's block, after the child array.
+};
+
+template <unsigned Size>
+struct BNodeValues<void, Size> {};
+
+template <>
+struct BNodeValues<void, DYNAMIC_DEGREE> {};
+
+
+// Number of keys in the subtree under a node, for b trees with order statistics.
+// Empty when Counted is false.
+template <bool Counted>
+struct BNodeCount {};
+
+template <>
+struct BNodeCount<true> {
+	std::size_t count;	// Number of keys in the subtree rooted at the node.
+};
+
+
+// Cached aggregate of the keys in the subtree under a node, for b trees augmented with a monoid.
+// Empty when Monoid is void.
+// A Monoid is a type with:
+//		typedef ... value_type;
+//		static value_type identity();
+//		static value_type lift(const T &key);
+//		static value_type combine(const value_type &left, const value_type &right);
+// combine must be associative and identity must be its identity element.
+// It is always applied to keys in order, so it does not need to be commutative.
+template <typename Monoid>
+struct BNodeAggregate {
+	typedef typename Monoid::value_type value_type;
+	value_type aggregate;	// Aggregate of the keys in the subtree rooted at the node, in order.
+};
+
+template <>
+struct BNodeAggregate<void> {
+	typedef void value_type;
+};
+
 
+// Latch guarding a node, for b trees that threads change concurrently.
+// Empty when Latched is false.
+template <bool Latched>
+struct BNodeLatch {};
 
-// struct for representing nodes of a b tree
-template <typename T>
-struct BNode {
-	BNode<T> **child;	// Array of pointers to children.
-	T *key;				// Array of keys.
+template <>
+struct BNodeLatch<true> {
+	NodeLatch latch;	// Held shared to read the node and exclusively to change it.
+};
+
+
+// struct for representing nodes of a b tree with a compile-time minimum degree.
+// The arrays are sized from Degree, so loops over them have fixed trip counts.
+// Mapped is the type of the values stored with the keys, or void if there are none.
+// Counted is whether the node keeps the number of keys in its subtree.
+// Monoid is the policy for the aggregate the node caches of its subtree, or void for none.
+// Latched is whether the node carries a latch.
+template <typename T, unsigned Degree = DYNAMIC_DEGREE, typename Mapped = void, bool Counted = false, typename Monoid = void, bool Latched = false>
+struct BNode : BNodeValues<Mapped, 2 * Degree - 1>, BNodeCount<Counted>, BNodeAggregate<Monoid>, BNodeLatch<Latched> {
+	unsigned size;											// Number of keys.
+	bool leaf;												// Whether the node is a leaf.
+	std::array<T, 2 * Degree - 1> key;						// Array of keys.
+	std::array<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, 2 * Degree> child;	// Array of pointers to children.
+};
+
+
+// struct for representing nodes of a b tree whose minimum degree is chosen at runtime.
+// Each node is one cache-line-aligned block holding this header,
+// followed by the key array, the child array, and then any values.
+template <typename T, typename Mapped, bool Counted, typename Monoid, bool Latched>
+struct BNode<T, DYNAMIC_DEGREE, Mapped, Counted, Monoid, Latched> : BNodeValues<Mapped, DYNAMIC_DEGREE>, BNodeCount<Counted>, BNodeAggregate<Monoid>, BNodeLatch<Latched> {
+	BNode<T, DYNAMIC_DEGREE, Mapped, Counted, Monoid, Latched> **child;	// Array of pointers to children. Points into the node's block.
+	T *key;				// Array of keys. Points into the node's block, right after the header.
 	unsigned size;		// Number of keys.
 	bool leaf;			// Whether the node is a leaf.
 };
@@ -30,41 +150,282 @@ struct BNode {
 typedef char BTREE_EXCEPTION;
 
 
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+class LatchedBTree;
+
+
+// Default-constructed comparison functor, for trees that aren't given one.
+// Fails to compile for function pointers, which would default to NULL.
+template <typename Compare>
+Compare defaultCompare();
+
+
+// Searches n sorted keys for k.
+// Returns the index of the first key not less than k,
+// or of the first key greater than k if Upper is true.
+template <bool Upper, typename T, typename Compare>
+unsigned searchKeys(const T*, unsigned, const T&, Compare&);
+
+
 // class for representing b trees.
-template <typename T>
+// Compare is the type of the key-comparison functor. It is called as a less-than.
+// Degree is the minimum degree of the tree, or DYNAMIC_DEGREE to pick it at runtime.
+// Alloc is the allocator node slabs come from. It is rebound to char.
+// Counted is whether nodes keep subtree key counts, which rank, select, and countRange need.
+// Monoid is the policy for subtree aggregates, which aggregate needs, or void for none. See BNodeAggregate.
+// Mapped is the type of a value stored with each key, or void for none. Used by BTreeMap.
+// Latched is whether nodes carry latches and come from a shared pool. Used by LatchedBTree.
+template <typename T, typename Compare = std::less<T>, unsigned Degree = DYNAMIC_DEGREE, typename Alloc = std::allocator<char>,
+		bool Counted = false, typename Monoid = void, typename Mapped = void, bool Latched = false>
 class BTree {
+	template <typename, typename, unsigned, bool>
+	friend class LatchedBTree;
+
 public:
+
+	// Bidirectional iterator over the keys of the tree in order.
+	// Keeps the path from the root to its key, so moving to the next
+	// or previous key takes amortized constant time.
+	// Invalidated by any change to the tree.
+	class const_iterator {
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const T *pointer;
+		typedef const T &reference;
+
+		// Constructs an iterator that doesn't belong to any tree.
+		const_iterator();
+
+		const T &operator*() const;
+		const T *operator->() const;
+
+		// Moves to the next key.
+		// Amortized constant time.
+		const_iterator &operator++();
+		const_iterator operator++(int);
+
+		// Moves to the previous key.
+		// Decrementing the end iterator moves to the largest key.
+		// Amortized constant time.
+		const_iterator &operator--();
+		const_iterator operator--(int);
+
+		bool operator==(const const_iterator&) const;
+		bool operator!=(const const_iterator&) const;
+
+	private:
+		friend class BTree;
+
+		const_iterator(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*);
+
+		// Pushes x and its leftmost or rightmost descendants onto the path.
+		void descendLeft(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*);
+		void descendRight(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*);
+
+		// Pops finished nodes until reaching one with a key after its current child.
+		void ascend();
+
+		// Root of the tree, for decrementing the end iterator.
+		BNode<T, Degree, Mapped, Counted, Monoid, Latched> *root;
+
+		// Nodes from the root down to the node holding the current key.
+		BNode<T, Degree, Mapped, Counted, Monoid, Latched> *path[BTREE_MAX_HEIGHT];
+
+		// index[depth - 1] is the index of the current key in path[depth - 1].
+		// Each other index[i] is the child of path[i] that the path continues into.
+		unsigned index[BTREE_MAX_HEIGHT];
+
+		// Number of nodes on the path. 0 at the end.
+		unsigned depth;
+	};
+
+	typedef const_iterator iterator;
+
 	// Constructor
 	// First parameter is the minimum degree of the tree.
-	// Second parameter is the tree's key-comparison function.
+	// It is ignored if the tree has a compile-time degree.
+	// Second parameter is the tree's key-comparison functor.
 	// Third parameter is a function that prints keys.
+	// Fourth parameter is the allocator node slabs come from.
 	// Constant time.
-	BTree(unsigned, bool (*)(T, T), void (*)(T) = NULL);
+	BTree(unsigned, Compare = defaultCompare<Compare>(), void (*)(T) = NULL, const Alloc& = Alloc());
 
-	// Destructor.
+	// Constructor for trees with a compile-time degree.
+	// First parameter is the tree's key-comparison functor.
+	// Second parameter is a function that prints keys.
+	// Third parameter is the allocator node slabs come from.
+	// Constant time.
+	BTree(Compare = defaultCompare<Compare>(), void (*)(T) = NULL, const Alloc& = Alloc());
+
+	// Constructs a tree from a sorted range of keys with bulkLoad.
+	// First parameter is the minimum degree of the tree.
+	// It is ignored if the tree has a compile-time degree.
+	// The range comes next, then the fill factor, comparison functor, print function, and allocator.
+	// Linear time.
+	template <typename InputIt>
+	BTree(unsigned, InputIt, InputIt, double = 1.0, Compare = defaultCompare<Compare>(), void (*)(T) = NULL, const Alloc& = Alloc());
+
+	// Constructs a tree with a compile-time degree from a sorted range of keys with bulkLoad.
 	// Linear time.
-	~BTree<T>();
+	template <typename InputIt>
+	BTree(InputIt, InputIt, double = 1.0, Compare = defaultCompare<Compare>(), void (*)(T) = NULL, const Alloc& = Alloc());
+
+	// Destructor.
+	// Time linear in the number of slabs if keys and values are trivially destructible,
+	// and linear in the number of nodes otherwise.
+	~BTree();
+
+	// Removes every key from the tree and releases its memory.
+	// Time linear in the number of slabs if keys and values are trivially destructible,
+	// and linear in the number of nodes otherwise.
+	void clear();
 
 	// Inserts a key into the tree.
 	// Logorithmic time.
-	void insert(T);
+	void insert(const T&);
+	void insert(T&&);
+
+	// Inserts a key into the tree unless an equivalent key is already present.
+	// returnValue.first is the node and index of the new or existing key.
+	// returnValue.second is whether the key was inserted.
+	// The value of a newly inserted key is left for the caller to assign.
+	// Logorithmic time.
+	std::pair<std::pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned>, bool> insertUnique(T&&);
+
+	// Constructs a key from the arguments and inserts it into the tree.
+	// Logorithmic time.
+	template <typename... Args>
+	void emplace(Args&&...);
+
+	// Inserts the keys in a range, which doesn't need to be sorted.
+	// Sorts a copy of the keys and pushes them down the tree together,
+	// so a node on the path to several keys is visited once for all of them.
+	// Nodes that overflow are split into as many nodes as needed in one go.
+	// Only for trees without mapped values.
+	// Time is logorithmic per key, and shared by keys that land near each other.
+	template <typename InputIt>
+	void insertBatch(InputIt, InputIt);
 
 	// Removes a key from the tree.
 	// Throws a BTREE_EXCEPTION if no item was found to remove.
 	// Logorithmic time.
-	T remove(T);
+	T remove(const T&);
+
+	// Removes a key from the tree if it is present. Never throws.
+	// If the second parameter isn't NULL, the removed key is moved into it.
+	// Returns whether a key was removed.
+	// Logorithmic time.
+	bool erase(const T&, T* = NULL);
+
+	// Removes every key that is not less than the first parameter and is less than the second.
+	// Subtrees wholly inside the range are freed without being searched,
+	// and only the nodes along the two ends of the range are rebalanced.
+	// Only for trees without mapped values.
+	// Returns the number of keys removed.
+	// Logorithmic time, plus time linear in the number of nodes freed.
+	std::size_t eraseRange(const T&, const T&);
+
+	// Removes every key equivalent to one of the keys in a range,
+	// which doesn't need to be sorted.
+	// Sorts a copy of the keys and removes them in one pass down the tree,
+	// rebalancing each node once however many of its keys go.
+	// Only for trees without mapped values.
+	// Returns the number of keys removed.
+	// Time is logorithmic per key, and shared by keys that are near each other.
+	template <typename InputIt>
+	std::size_t eraseBatch(InputIt, InputIt);
 
 	// Function to find a key in the tree.
 	// returnValue.first is the node the item is in.
 	// returnValue.second is the correct index in that node's key array
 	// Logorithmic time.
-	std::pair<BNode<T>*, unsigned> search(T);
+	std::pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned> search(const T&);
 
 	// Uses search but just returns the key rather than the whole node.
 	// Useful when T is a key value pair and lessThan only looks at the key.
+	// The returned reference is invalidated by changes to the tree.
 	// Throws a BTREE_EXCEPTION if no item matching the parameter is found
 	// Logorithmic time.
-	T searchKey(T);
+	const T &searchKey(const T&);
+
+	// Searches for many keys at once. results[i] is set to search(keys[i]).
+	// Interleaves the descents: each lookup prefetches its next node and then
+	// yields to the others, so the cache misses of different lookups overlap.
+	// Parameters are the keys, how many there are, and the array for the results.
+	// Logorithmic time per key.
+	void findBatch(const T*, std::size_t, std::pair<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned>*);
+
+	// Like searchKey, but returns a copy of the key, or nothing if it isn't found.
+	// Never throws unless copying the key does.
+	// Logorithmic time.
+	std::optional<T> find(const T&);
+
+	// Whether a key equivalent to the parameter is in the tree.
+	// Logorithmic time.
+	bool contains(const T&);
+
+	// Replaces the keys in the tree with the keys in a range, which must be sorted.
+	// Packs the keys into leaves and builds each inner level above them,
+	// instead of inserting the keys one at a time.
+	// Third parameter is the fraction of each node's 2t - 1 slots to fill.
+	// It is adjusted as needed to keep every node between t - 1 and 2t - 1 keys.
+	// Linear time.
+	template <typename InputIt>
+	void bulkLoad(InputIt, InputIt, double = 1.0);
+
+	// Bulk loads a range like bulkLoad, building each level's nodes on a pool of threads.
+	// Third parameter is the fill factor.
+	// Fourth parameter is the number of threads, or 0 for one per hardware thread.
+	// If the fifth parameter is false, the keys are copied and sorted in parallel first.
+	// Linear time, or n lg(n) time to sort.
+	template <typename InputIt>
+	void parallelBulkLoad(InputIt, InputIt, double = 1.0, unsigned = 0, bool = true);
+
+	// Number of keys in the tree that are less than a key.
+	// Only for trees with Counted set.
+	// Logorithmic time.
+	std::size_t rank(const T&);
+
+	// The key with a given number of smaller keys before it in the tree.
+	// Throws a BTREE_EXCEPTION if the tree doesn't have that many keys.
+	// Only for trees with Counted set.
+	// Logorithmic time.
+	const T &select(std::size_t);
+
+	// Number of keys in the tree that are not less than the first parameter,
+	// and are less than the second.
+	// Only for trees with Counted set.
+	// Logorithmic time.
+	std::size_t countRange(const T&, const T&);
+
+	// Combination in order of the lifted keys that are not less than the first parameter,
+	// and are less than the second. The Monoid's identity if there are none.
+	// Whole subtrees inside the range contribute their cached aggregates.
+	// Only for trees with a Monoid.
+	// O(t lg(n)) time.
+	typename BNodeAggregate<Monoid>::value_type aggregate(const T&, const T&);
+
+	// Iterator to the smallest key in the tree.
+	// Logorithmic time.
+	const_iterator begin();
+
+	// Iterator past the largest key in the tree.
+	// Constant time.
+	const_iterator end();
+
+	// Iterator to the first key that is not less than a key.
+	// Logorithmic time.
+	const_iterator lower_bound(const T&);
+
+	// Iterator to the first key that is greater than a key.
+	// Logorithmic time.
+	const_iterator upper_bound(const T&);
+
+	// The range of keys equivalent to a key, as lower_bound and upper_bound.
+	// Logorithmic time.
+	std::pair<const_iterator, const_iterator> equal_range(const T&);
 
 	// Prints the tree.
 	// Linear time
@@ -72,45 +433,193 @@ public:
 
 private:
 
-	// Used for initializing nodes.
-	void initializeNode(BNode<T>*);
+	// The minimum degree of the tree.
+	// A constant when the tree has a compile-time degree.
+	unsigned degree() const;
+
+	// Allocates and initializes a node as a single block from the pool.
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *newNode();
+
+	// Destroys a node's keys and returns its block to the pool, or passes the node to retireNode if it is set.
+	void deleteNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*);
+
+	// Destroys a node's keys without freeing its block.
+	void destroyNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*);
 
-	// Recursive function called by destructor.
-	void freeNode(BNode<T>*);
+	// Deletes a subtree, returning its blocks to the pool.
+	// Returns the number of keys it held.
+	std::size_t freeNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*);
 
-	// Finds the index of a key in a node.
-	unsigned findIndex(BNode<T>*, T);
+	// Deletes every node and releases every slab. Leaves root dangling.
+	void freeAll();
+
+	// Recomputes a node's subtree key count and aggregate from its keys and its children.
+	// Does nothing unless Counted is set or there is a Monoid.
+	void refreshNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*);
+
+	// Updates the first n nodes of a path, from the root down, after keys were added or removed below them.
+	// Third parameter is the change in the number of keys.
+	// Does nothing unless Counted is set or there is a Monoid.
+	void refreshPath(BNode<T, Degree, Mapped, Counted, Monoid, Latched>**, unsigned, long);
+
+	// Aggregate of the keys in a subtree between two optional bounds, as aggregate.
+	// A NULL bound leaves that side of the range open.
+	typename BNodeAggregate<Monoid>::value_type aggregateNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, const T*, const T*);
+
+	// Starts loading a node into cache. See BTREE_PREFETCH.
+	void prefetchNode(const BNode<T, Degree, Mapped, Counted, Monoid, Latched>*) const;
+
+	// Finds the index of the first key in a node that is not less than a key.
+	unsigned findIndex(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, const T&);
+
+	// Finds the index of the first key in a node that is greater than a key.
+	unsigned findUpperIndex(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, const T&);
 
 	// Inserts a key into a node.
-	unsigned nodeInsert(BNode<T>*, T);
+	unsigned nodeInsert(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, T&&);
+
+	// Inserts a key into a node at a given index.
+	void nodeInsertAt(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned, T&&);
 
 	// Deletes the key at a given index from a node.
-	T nodeDelete(BNode<T>*, unsigned);
+	T nodeDelete(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned);
+
+	// Opens an empty slot at a given index in a node.
+	void nodeOpen(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned);
+
+	// Closes the slot at a given index in a node.
+	void nodeClose(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned);
+
+	// Moves a key, and its value if there is one, from one node slot to another.
+	void moveEntry(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned, BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned);
 
 	// Function for splitting nodes that are too full.
-	void splitChild(BNode<T>*, int);
+	void splitChild(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, int);
 
 	// Merges two children of a node at a given index into one child.
-	char mergeChildren(BNode<T>*, unsigned);
+	char mergeChildren(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned);
+
+	// Moves the last key of a child's left sibling up into the node, and the node's separating key down into the child.
+	void rotateFromLeft(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned);
+
+	// Moves the first key of a child's right sibling up into the node, and the node's separating key down into the child.
+	void rotateFromRight(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned);
 
 	// Makes sure the child of a node at a specified index has >= minDegree items.
-	char fixChildSize(BNode<T>*, unsigned);
+	char fixChildSize(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned);
+
+	// Inserts a sorted run of keys into a subtree.
+	// If the subtree's root overflows, it is split into the nodes put in the fourth parameter,
+	// starting with the subtree's root, separated by the keys put in the fifth.
+	void insertRun(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, T*, T*, std::vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*>&, std::vector<T>&);
+
+	// A range of keys to erase. Runs from lo up to hi, and includes hi if closed is true.
+	struct EraseRange {
+		const T *lo;
+		const T *hi;
+		bool closed;
+	};
+
+	// Erases the keys in a sorted run of disjoint ranges from a subtree.
+	// Returns the number of keys erased. The subtree's root may be left with too few keys.
+	std::size_t eraseRuns(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, const EraseRange*, const EraseRange*);
+
+	// Joins two subtrees of the same height, the first holding the smaller keys,
+	// into the nodes put in the third parameter, separated by the keys put in the fourth.
+	void concatNodes(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, std::vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*>&, std::vector<T>&);
+
+	// Merges any child with too few keys in a flattened run of keys and children with a neighbour.
+	void mergeUnderfull(std::vector<T>&, std::vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*>&);
+
+	// Moves a node's keys, and its children if it has any, onto the ends of a flattened run.
+	void flattenNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, std::vector<T>&, std::vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*>&);
+
+	// Replaces the root with its only child for as long as the root has no keys.
+	void shrinkRoot();
+
+	// Deals a flattened run of keys, and of children if it isn't a leaf run, out to
+	// as few nodes as keep each between t - 1 and 2t - 1 keys.
+	// The third parameter holds nodes to reuse. Nodes are allocated or freed to match,
+	// and the keys that separate the nodes go in the fourth parameter.
+	void repartition(std::vector<T>&, std::vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*>&, std::vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*>&, std::vector<T>&);
+
+	// Number of nodes to split a level of n keys into, so that each node gets
+	// about a target number of keys and the leftover keys separate the nodes.
+	std::size_t bulkGroups(std::size_t, std::size_t);
+
+	// Replaces the keys in the tree with a number of sorted keys, building levels in parallel.
+	template <typename RandomIt>
+	void parallelBuild(RandomIt, std::size_t, double, ThreadPool&);
+
+	// Fills the nodes of one bulk-loaded level from n sorted keys, in parallel.
+	// Nodes i and i + 1 are separated by key i of the last parameter.
+	// Inner levels also take the level below as children, leaves take NULL.
+	template <typename RandomIt>
+	void fillLevel(std::vector<BNode<T, Degree, Mapped, Counted, Monoid, Latched>*>&, RandomIt, std::size_t, BNode<T, Degree, Mapped, Counted, Monoid, Latched>**, std::vector<T>&, ThreadPool&);
+
+	// Sorts keys in parallel chunks and merges the chunks pairwise.
+	void parallelSort(std::vector<T>&, ThreadPool&);
+
+	// Finds the first key that is not less than, or greater than if Upper is true, a key.
+	template <bool Upper>
+	const_iterator bound(const T&);
 
 	// Recursively prints a subtree.
-	void printNode(BNode<T>*, unsigned);
+	void printNode(BNode<T, Degree, Mapped, Counted, Monoid, Latched>*, unsigned);
 
 	// Root node.
-	BNode<T> *root;
+	BNode<T, Degree, Mapped, Counted, Monoid, Latched> *root;
 
-	// Comparison function used for managing element placement.
-	bool (*lessThan)(T, T);
+	// Comparison functor used for managing element placement.
+	Compare lessThan;
 
 	// Function used to print items in the tree.
 	void (*printKey)(T);
 
-	// Minimum degree of the tree.
+	// Function deleteNode hands nodes to instead of freeing them, with retireContext as its first argument.
+	// Set by LatchedBTree when threads may still be reading a node after it is unlinked. NULL otherwise.
+	void (*retireNode)(void*, BNode<T, Degree, Mapped, Counted, Monoid, Latched>*);
+	void *retireContext;
+
+	// Minimum degree of the tree when Degree is DYNAMIC_DEGREE.
 	unsigned minDegree;
+
+	// Offsets of the key, child, and value arrays within a node's block.
+	// Only used when Degree is DYNAMIC_DEGREE.
+	std::size_t keyOffset;
+	std::size_t childOffset;
+	std::size_t valueOffset;
+
+	// Size in bytes of a node's block. A multiple of CACHE_LINE_SIZE.
+	std::size_t nodeSize;
+
+	// Slabs that node blocks are carved from, and the free list of recycled blocks.
+	// Declared last so it is destroyed after the nodes have been.
+	// Shared between threads if the tree is Latched.
+	NodePool<Alloc, CACHE_LINE_SIZE, Latched> pool;
 };
 
 
+// A b tree whose minimum degree is a compile-time constant.
+template <typename T, unsigned Degree, typename Compare = std::less<T>>
+using StaticBTree = BTree<T, Compare, Degree>;
+
+
+// A b tree whose nodes count the keys under them, for rank and select queries.
+template <typename T, unsigned Degree = DYNAMIC_DEGREE, typename Compare = std::less<T>>
+using CountedBTree = BTree<T, Compare, Degree, std::allocator<char>, true>;
+
+
+// A b tree whose nodes cache an aggregate of the keys under them, for range aggregate queries.
+// See BNodeAggregate for what a Monoid provides.
+template <typename T, typename Monoid, unsigned Degree = DYNAMIC_DEGREE, typename Compare = std::less<T>>
+using AggregateBTree = BTree<T, Compare, Degree, std::allocator<char>, false, Monoid>;
+
+
+// A b tree that compares keys with a plain function.
+// Construct it with the function as the comparison parameter. It has no default.
+template <typename T, unsigned Degree = DYNAMIC_DEGREE>
+using FunctionBTree = BTree<T, bool (*)(T, T), Degree>;
+
+
 #include "bTree.cpp"
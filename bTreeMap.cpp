@@ -0,0 +1,103 @@
+/* B-Tree Map
+ * Summary:	A map from keys to values built on the B-Tree.
+ */
+
+
+#pragma once
+
+
+#include <utility>
+
+
+using namespace std;
+
+
+// Constructor for b tree maps.
+// t is the minimum degree of the tree.
+// compare is the comparison functor used for ordering keys.
+template <typename K, typename V, typename Compare, unsigned Degree>
+BTreeMap<K, V, Compare, Degree>::BTreeMap(unsigned t, Compare compare) : tree(t, compare) {}
+
+
+// Constructor for b tree maps with a compile-time degree.
+// compare is the comparison functor used for ordering keys.
+template <typename K, typename V, typename Compare, unsigned Degree>
+BTreeMap<K, V, Compare, Degree>::BTreeMap(Compare compare) : tree(compare) {}
+
+
+// Finds the value mapped to k.
+// Returns NULL if k is not in the map.
+template <typename K, typename V, typename Compare, unsigned Degree>
+V *BTreeMap<K, V, Compare, Degree>::find(const K &k) {
+	pair<BNode<K, Degree, V>*, unsigned> node = tree.search(k);
+	if (node.first == NULL) {
+		return NULL;
+	}
+	return &node.first->value[node.second];
+}
+
+
+// Returns the value mapped to k, mapping k to a default value first if needed.
+template <typename K, typename V, typename Compare, unsigned Degree>
+V &BTreeMap<K, V, Compare, Degree>::operator[](const K &k) {
+	return *try_emplace(k).first;
+}
+
+
+// Returns the value mapped to k, mapping k to a default value first if needed.
+template <typename K, typename V, typename Compare, unsigned Degree>
+V &BTreeMap<K, V, Compare, Degree>::operator[](K &&k) {
+	return *try_emplace(std::move(k)).first;
+}
+
+
+// Maps k to v, whether or not k was already in the map.
+template <typename K, typename V, typename Compare, unsigned Degree>
+template <typename M>
+pair<V*, bool> BTreeMap<K, V, Compare, Degree>::insert_or_assign(const K &k, M &&v) {
+	return insert_or_assign(K(k), std::forward<M>(v));
+}
+
+
+// Maps k to v, whether or not k was already in the map.
+template <typename K, typename V, typename Compare, unsigned Degree>
+template <typename M>
+pair<V*, bool> BTreeMap<K, V, Compare, Degree>::insert_or_assign(K &&k, M &&v) {
+	pair<pair<BNode<K, Degree, V>*, unsigned>, bool> result = tree.insertUnique(std::move(k));
+	V *value = &result.first.first->value[result.first.second];
+	*value = std::forward<M>(v);
+	return make_pair(value, result.second);
+}
+
+
+// Maps k to a value constructed from args if k is not already in the map.
+template <typename K, typename V, typename Compare, unsigned Degree>
+template <typename... Args>
+pair<V*, bool> BTreeMap<K, V, Compare, Degree>::try_emplace(const K &k, Args&&... args) {
+	V *value = find(k);
+	if (value != NULL) {
+		return make_pair(value, false);
+	}
+	return try_emplace(K(k), std::forward<Args>(args)...);
+}
+
+
+// Maps k to a value constructed from args if k is not already in the map.
+template <typename K, typename V, typename Compare, unsigned Degree>
+template <typename... Args>
+pair<V*, bool> BTreeMap<K, V, Compare, Degree>::try_emplace(K &&k, Args&&... args) {
+	pair<pair<BNode<K, Degree, V>*, unsigned>, bool> result = tree.insertUnique(std::move(k));
+	V *value = &result.first.first->value[result.first.second];
+	if (result.second) {
+		*value = V(std::forward<Args>(args)...);
+	}
+	return make_pair(value, result.second);
+}
+
+
+// Removes k and its value from the map.
+// Returns whether k was in the map.
+template <typename K, typename V, typename Compare, unsigned Degree>
+bool BTreeMap<K, V, Compare, Degree>::erase(const K &k) {
+	return tree.erase(k);
+}
@@ -0,0 +1,79 @@
+/* B-Tree Map
+ * Summary:	A map from keys to values built on the B-Tree.
+ *			Keys are unique. Values are stored in an array parallel to each node's
+ *			keys, so searching a node only reads key bytes.
+ *			Most standard operations run in O(lg(n)) time.
+ */
+
+
+#pragma once
+
+#include <utility>
+
+#include "bTree.h"
+
+
+// class for representing maps backed by b trees.
+// K is the key type and V is the value type.
+// V must be default constructible; empty value slots hold default constructed values.
+// Compare and Degree work as they do for BTree.
+template <typename K, typename V, typename Compare = std::less<K>, unsigned Degree = DYNAMIC_DEGREE>
+class BTreeMap {
+public:
+	// Constructor
+	// First parameter is the minimum degree of the tree.
+	// It is ignored if the map has a compile-time degree.
+	// Second parameter is the map's key-comparison functor.
+	// Constant time.
+	BTreeMap(unsigned, Compare = defaultCompare<Compare>());
+
+	// Constructor for maps with a compile-time degree.
+	// First parameter is the map's key-comparison functor.
+	// Constant time.
+	BTreeMap(Compare = defaultCompare<Compare>());
+
+	// Finds the value mapped to a key.
+	// Returns NULL if the key is not present.
+	// The returned pointer is invalidated by changes to the map.
+	// Logorithmic time.
+	V *find(const K&);
+
+	// Returns a reference to the value mapped to a key,
+	// inserting a default constructed value if the key is not present.
+	// The returned reference is invalidated by changes to the map.
+	// Logorithmic time.
+	V &operator[](const K&);
+	V &operator[](K&&);
+
+	// Maps a key to a value, replacing any value it was already mapped to.
+	// returnValue.first points to the value in the map.
+	// returnValue.second is whether the key was inserted.
+	// Logorithmic time.
+	template <typename M>
+	std::pair<V*, bool> insert_or_assign(const K&, M&&);
+	template <typename M>
+	std::pair<V*, bool> insert_or_assign(K&&, M&&);
+
+	// Maps a key to a value constructed from the arguments, unless the key is already present.
+	// The arguments are not used if the key is already present.
+	// returnValue.first points to the value in the map.
+	// returnValue.second is whether the key was inserted.
+	// Logorithmic time.
+	template <typename... Args>
+	std::pair<V*, bool> try_emplace(const K&, Args&&...);
+	template <typename... Args>
+	std::pair<V*, bool> try_emplace(K&&, Args&&...);
+
+	// Removes a key and its value from the map.
+	// Returns whether the key was present.
+	// Logorithmic time.
+	bool erase(const K&);
+
+private:
+
+	// Tree holding the keys, with the values in each node's parallel array.
+	BTree<K, Compare, Degree, std::allocator<char>, false, void, V> tree;
+};
+
+
+#include "bTreeMap.cpp"
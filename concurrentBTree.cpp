@@ -0,0 +1,161 @@
+/* Concurrent B-Tree
+ * Summary:	A b tree behind a reader-writer lock.
+ */
+
+
+#pragma once
+
+
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+
+
+using namespace std;
+
+
+// Constructor for concurrent b trees.
+// t is the minimum degree of the tree.
+// compare is the comparison functor used for ordering keys.
+template <typename T, typename Compare, unsigned Degree>
+ConcurrentBTree<T, Compare, Degree>::ConcurrentBTree(unsigned t, Compare compare) : lessThan(compare), tree(t, compare) {}
+
+
+// Constructor for concurrent b trees with a compile-time degree.
+// compare is the comparison functor used for ordering keys.
+template <typename T, typename Compare, unsigned Degree>
+ConcurrentBTree<T, Compare, Degree>::ConcurrentBTree(Compare compare) : lessThan(compare), tree(compare) {}
+
+
+// Inserts a copy of k.
+template <typename T, typename Compare, unsigned Degree>
+void ConcurrentBTree<T, Compare, Degree>::insert(const T &k) {
+	insert(T(k));
+}
+
+
+// Inserts k, moving it into the tree.
+// k is moved before the lock is taken, since it could be expensive to copy.
+template <typename T, typename Compare, unsigned Degree>
+void ConcurrentBTree<T, Compare, Degree>::insert(T &&k) {
+	unique_lock<DistributedSharedMutex> guard(lock);
+	tree.insert(std::move(k));
+}
+
+
+// Inserts a copy of k if no equivalent key is present.
+template <typename T, typename Compare, unsigned Degree>
+bool ConcurrentBTree<T, Compare, Degree>::insertUnique(const T &k) {
+	return insertUnique(T(k));
+}
+
+
+// Inserts k if no equivalent key is present.
+template <typename T, typename Compare, unsigned Degree>
+bool ConcurrentBTree<T, Compare, Degree>::insertUnique(T &&k) {
+	unique_lock<DistributedSharedMutex> guard(lock);
+	return tree.insertUnique(std::move(k)).second;
+}
+
+
+// Removes k if it is present, moving it into out if out isn't NULL.
+template <typename T, typename Compare, unsigned Degree>
+bool ConcurrentBTree<T, Compare, Degree>::erase(const T &k, T *out) {
+	unique_lock<DistributedSharedMutex> guard(lock);
+	return tree.erase(k, out);
+}
+
+
+// Inserts the keys in [first, last).
+template <typename T, typename Compare, unsigned Degree>
+template <typename InputIt>
+void ConcurrentBTree<T, Compare, Degree>::insertBatch(InputIt first, InputIt last) {
+	unique_lock<DistributedSharedMutex> guard(lock);
+	tree.insertBatch(first, last);
+}
+
+
+// Removes the keys k with lo <= k < hi.
+template <typename T, typename Compare, unsigned Degree>
+size_t ConcurrentBTree<T, Compare, Degree>::eraseRange(const T &lo, const T &hi) {
+	unique_lock<DistributedSharedMutex> guard(lock);
+	return tree.eraseRange(lo, hi);
+}
+
+
+// Replaces the tree's keys with the sorted keys in [first, last).
+template <typename T, typename Compare, unsigned Degree>
+template <typename InputIt>
+void ConcurrentBTree<T, Compare, Degree>::bulkLoad(InputIt first, InputIt last, double fill) {
+	unique_lock<DistributedSharedMutex> guard(lock);
+	tree.bulkLoad(first, last, fill);
+}
+
+
+// Deletes every key.
+template <typename T, typename Compare, unsigned Degree>
+void ConcurrentBTree<T, Compare, Degree>::clear() {
+	unique_lock<DistributedSharedMutex> guard(lock);
+	tree.clear();
+}
+
+
+// Copy of the key equivalent to k, if there is one.
+template <typename T, typename Compare, unsigned Degree>
+optional<T> ConcurrentBTree<T, Compare, Degree>::find(const T &k) {
+	shared_lock<DistributedSharedMutex> guard(lock);
+	return tree.find(k);
+}
+
+
+// Whether a key equivalent to k is present.
+template <typename T, typename Compare, unsigned Degree>
+bool ConcurrentBTree<T, Compare, Degree>::contains(const T &k) {
+	shared_lock<DistributedSharedMutex> guard(lock);
+	return tree.contains(k);
+}
+
+
+// Calls f on each key k with lo <= k < hi.
+template <typename T, typename Compare, unsigned Degree>
+template <typename F>
+void ConcurrentBTree<T, Compare, Degree>::forRange(const T &lo, const T &hi, F f) {
+	if (!lessThan(lo, hi)) {
+		return;
+	}
+	shared_lock<DistributedSharedMutex> guard(lock);
+	typename BTree<T, Compare, Degree>::const_iterator last = tree.lower_bound(hi);
+	for (typename BTree<T, Compare, Degree>::const_iterator it = tree.lower_bound(lo); it != last; ++it) {
+		f(*it);
+	}
+}
+
+
+// Calls f on every key.
+template <typename T, typename Compare, unsigned Degree>
+template <typename F>
+void ConcurrentBTree<T, Compare, Degree>::forEach(F f) {
+	shared_lock<DistributedSharedMutex> guard(lock);
+	for (const T &k : tree) {
+		f(k);
+	}
+}
+
+
+// Returns f(tree) with the tree locked shared.
+template <typename T, typename Compare, unsigned Degree>
+template <typename F>
+auto ConcurrentBTree<T, Compare, Degree>::read(F f) -> decltype(std::declval<F&>()(std::declval<BTree<T, Compare, Degree>&>())) {
+	shared_lock<DistributedSharedMutex> guard(lock);
+	return f(tree);
+}
+
+
+// Returns f(tree) with the tree locked exclusively.
+template <typename T, typename Compare, unsigned Degree>
+template <typename F>
+auto ConcurrentBTree<T, Compare, Degree>::write(F f) -> decltype(std::declval<F&>()(std::declval<BTree<T, Compare, Degree>&>())) {
+	unique_lock<DistributedSharedMutex> guard(lock);
+	return f(tree);
+}
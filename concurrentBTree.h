@@ -0,0 +1,114 @@
+/* Concurrent B-Tree
+ * Summary:	A b tree that many threads can use at once.
+ *			Lookups and iteration share the tree, and changes take it exclusively,
+ *			through a DistributedSharedMutex so that readers on different cores
+ *			don't contend on one lock word.
+ *			Most standard operations run in O(lg(n)) time.
+ */
+
+
+#pragma once
+
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+
+#include "bTree.h"
+#include "distributedLock.h"
+
+
+// class for representing b trees shared between threads.
+// Compare and Degree work as they do for BTree.
+// Nothing returned points into the tree, since another thread could change it.
+// Keys are copied out instead, or visited while the lock is held.
+template <typename T, typename Compare = std::less<T>, unsigned Degree = DYNAMIC_DEGREE>
+class ConcurrentBTree {
+public:
+	// Constructor
+	// First parameter is the minimum degree of the tree.
+	// It is ignored if the tree has a compile-time degree.
+	// Second parameter is the tree's key-comparison functor.
+	// Constant time.
+	ConcurrentBTree(unsigned, Compare = defaultCompare<Compare>());
+
+	// Constructor for trees with a compile-time degree.
+	// First parameter is the tree's key-comparison functor.
+	// Constant time.
+	ConcurrentBTree(Compare = defaultCompare<Compare>());
+
+	// Inserts a key into the tree.
+	// Logorithmic time.
+	void insert(const T&);
+	void insert(T&&);
+
+	// Inserts a key if no equivalent key is in the tree.
+	// Returns whether it was inserted.
+	// Logorithmic time.
+	bool insertUnique(const T&);
+	bool insertUnique(T&&);
+
+	// Removes a key equivalent to the first parameter, as BTree::erase.
+	// Returns whether a key was removed.
+	// Logorithmic time.
+	bool erase(const T&, T* = NULL);
+
+	// Inserts a range of keys under one exclusive lock, as BTree::insertBatch.
+	template <typename InputIt>
+	void insertBatch(InputIt, InputIt);
+
+	// Removes every key not less than the first parameter and less than the second, as BTree::eraseRange.
+	// Returns the number of keys removed.
+	std::size_t eraseRange(const T&, const T&);
+
+	// Replaces the contents of the tree with a sorted range, as BTree::bulkLoad.
+	template <typename InputIt>
+	void bulkLoad(InputIt, InputIt, double = 1.0);
+
+	// Deletes every key.
+	// Linear time.
+	void clear();
+
+	// Copy of the key equivalent to the parameter, or nothing if there is none.
+	// Logorithmic time.
+	std::optional<T> find(const T&);
+
+	// Whether a key equivalent to the parameter is in the tree.
+	// Logorithmic time.
+	bool contains(const T&);
+
+	// Calls a function on each key not less than the first parameter and less than the second, in order.
+	// The tree is locked shared for the whole visit, so the function must not change it.
+	// Logorithmic time plus linear time in the number of keys visited.
+	template <typename F>
+	void forRange(const T&, const T&, F);
+
+	// Calls a function on every key in order, as forRange.
+	// Linear time.
+	template <typename F>
+	void forEach(F);
+
+	// Calls a function on the underlying tree while it is locked shared, and returns its result.
+	// For reads that aren't covered above. The function must not change the tree
+	// or keep pointers, references or iterators into it after returning.
+	template <typename F>
+	auto read(F) -> decltype(std::declval<F&>()(std::declval<BTree<T, Compare, Degree>&>()));
+
+	// Calls a function on the underlying tree while it is locked exclusively, and returns its result.
+	// The function must not keep pointers, references or iterators into the tree after returning.
+	template <typename F>
+	auto write(F) -> decltype(std::declval<F&>()(std::declval<BTree<T, Compare, Degree>&>()));
+
+private:
+
+	// Shared by readers and taken exclusively by writers.
+	DistributedSharedMutex lock;
+
+	// Copy of the tree's key-comparison functor, for checking ranges.
+	Compare lessThan;
+
+	// The tree being shared.
+	BTree<T, Compare, Degree> tree;
+};
+
+
+#include "concurrentBTree.cpp"
@@ -0,0 +1,66 @@
+/* Distributed Lock
+ * Summary:	Reader-writer lock with per-slot reader counters.
+ */
+
+
+#pragma once
+
+
+// Constructor for distributed locks.
+inline DistributedSharedMutex::DistributedSharedMutex() : writing(false) {
+	for (Slot &s : slots) {
+		s.readers.store(0, std::memory_order_relaxed);
+	}
+}
+
+
+// Takes the lock exclusively.
+// writing is set before the counters are read, and readers count themselves before
+// they read writing, so either the writer sees a reader or the reader sees the writer.
+inline void DistributedSharedMutex::lock() {
+	writers.lock();
+	writing.store(true);
+	for (Slot &s : slots) {
+		while (s.readers.load() != 0) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+
+// Releases an exclusive lock.
+inline void DistributedSharedMutex::unlock() {
+	writing.store(false);
+	writers.unlock();
+}
+
+
+// Takes the lock shared.
+// If a writer is in, backs out of the slot so the writer isn't kept waiting, and tries again once it's gone.
+inline void DistributedSharedMutex::lock_shared() {
+	std::atomic<long> &readers = slots[slot()].readers;
+	while (true) {
+		readers.fetch_add(1);
+		if (!writing.load()) {
+			return;
+		}
+		readers.fetch_sub(1);
+		while (writing.load(std::memory_order_relaxed)) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+
+// Releases a shared lock.
+inline void DistributedSharedMutex::unlock_shared() {
+	slots[slot()].readers.fetch_sub(1, std::memory_order_release);
+}
+
+
+// The slot of the calling thread.
+inline std::size_t DistributedSharedMutex::slot() {
+	static std::atomic<std::size_t> nextSlot(0);
+	thread_local std::size_t mine = nextSlot.fetch_add(1, std::memory_order_relaxed) % BTREE_READER_SLOTS;
+	return mine;
+}
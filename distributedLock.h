@@ -0,0 +1,74 @@
+/* Distributed Lock
+ * Summary:	A reader-writer lock whose readers count themselves in one of many
+ *			counters, each on its own cache line, instead of in a single shared
+ *			word. Readers on different cores then don't write to the same line,
+ *			so shared locking scales with the number of readers.
+ *			Writers are rarer and pay for it by checking every counter.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+// Number of reader counters in each lock.
+// Threads are spread over them in the order they first take a shared lock.
+#ifndef BTREE_READER_SLOTS
+#define BTREE_READER_SLOTS 64
+#endif
+
+
+// Reader-writer lock with a reader counter per slot.
+// Meets the SharedMutex requirements used by std::shared_lock and std::unique_lock.
+// Writers take priority: once one is waiting, new readers hold off until it is done.
+// Not recursive, and a shared lock can't be upgraded.
+class DistributedSharedMutex {
+public:
+	// Constructor
+	// Starts unlocked.
+	DistributedSharedMutex();
+
+	DistributedSharedMutex(const DistributedSharedMutex&) = delete;
+	DistributedSharedMutex &operator=(const DistributedSharedMutex&) = delete;
+
+	// Takes the lock exclusively.
+	// Waits for other writers, and then for every reader to leave.
+	// Linear time in BTREE_READER_SLOTS, plus waiting.
+	void lock();
+
+	// Releases an exclusive lock.
+	void unlock();
+
+	// Takes the lock shared.
+	// Only writes the calling thread's slot unless a writer holds or wants the lock.
+	void lock_shared();
+
+	// Releases a shared lock.
+	void unlock_shared();
+
+private:
+
+	// Reader counter padded to a cache line so slots never share one.
+	struct alignas(64) Slot {
+		std::atomic<long> readers;
+	};
+
+	// The slot of the calling thread.
+	// Assigned round robin the first time a thread asks.
+	static std::size_t slot();
+
+	// Readers holding the lock, by slot.
+	Slot slots[BTREE_READER_SLOTS];
+
+	// Whether a writer holds or is waiting for the lock.
+	std::atomic<bool> writing;
+
+	// Serializes writers.
+	std::mutex writers;
+};
+
+
+#include "distributedLock.cpp"
@@ -0,0 +1,149 @@
+/* Epoch Reclamation
+ * Summary:	Thread records, epoch advancing, and retired lists.
+ */
+
+
+#pragma once
+
+
+// Notes the current epoch, unless the thread is already in a guard.
+// The fence keeps the thread's reads of shared nodes from moving ahead of the note,
+// so a thread advancing the epoch either sees the note or retired the node before it was read.
+inline EpochGuard::EpochGuard() {
+	EpochManager::Record *r = EpochManager::record();
+	if (r->depth++ == 0) {
+		r->epoch.store(EpochManager::epoch().load(std::memory_order_relaxed), std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+}
+
+
+// Marks the thread quiescent when its outermost guard ends.
+inline EpochGuard::~EpochGuard() {
+	EpochManager::Record *r = EpochManager::record();
+	if (--r->depth == 0) {
+		r->epoch.store(EPOCH_QUIESCENT, std::memory_order_release);
+	}
+}
+
+
+// Adds object to the calling thread's list, tagged with the epoch it was unlinked in.
+inline void EpochManager::retire(void *object, Deleter deleter, void *context) {
+	Record *r = record();
+	size_t waiting;
+	{
+		std::lock_guard<std::mutex> guard(r->lock);
+		r->retired.push_back(Retired{object, deleter, context, epoch().load()});
+		waiting = r->retired.size();
+	}
+	if (waiting % BTREE_EPOCH_BATCH == 0) {
+		advance();
+		reclaim(r);
+	}
+}
+
+
+// Advances the epoch if it can, and frees what the calling thread has retired that is old enough.
+inline void EpochManager::reclaim() {
+	advance();
+	reclaim(record());
+}
+
+
+// Frees every retired object owned by context, in every record.
+inline void EpochManager::flush(void *context) {
+	for (Record *r = records().load(std::memory_order_acquire); r != NULL; r = r->next) {
+		std::lock_guard<std::mutex> guard(r->lock);
+		size_t kept = 0;
+		for (Retired &x : r->retired) {
+			if (x.context == context) {
+				x.deleter(x.context, x.object);
+			}
+			else {
+				r->retired[kept++] = x;
+			}
+		}
+		r->retired.resize(kept);
+	}
+}
+
+
+// Releases the record when the thread ends.
+inline EpochManager::Owner::~Owner() {
+	record->taken.store(false, std::memory_order_release);
+}
+
+
+// The calling thread's record.
+inline EpochManager::Record *EpochManager::record() {
+	thread_local Owner owner{acquire()};
+	return owner.record;
+}
+
+
+// Takes the first free record, or pushes a new one onto the front of the list.
+// Records are only ever added, so the list can be walked without a lock.
+inline EpochManager::Record *EpochManager::acquire() {
+	for (Record *r = records().load(std::memory_order_acquire); r != NULL; r = r->next) {
+		bool free = false;
+		if (!r->taken.load(std::memory_order_relaxed) && r->taken.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+			return r;
+		}
+	}
+
+	Record *r = new Record;
+	r->epoch.store(EPOCH_QUIESCENT, std::memory_order_relaxed);
+	r->taken.store(true, std::memory_order_relaxed);
+	r->depth = 0;
+	r->next = records().load(std::memory_order_relaxed);
+	while (!records().compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed));
+	return r;
+}
+
+
+// Moves the epoch on by one if no thread's guard saw an older one.
+// Losing the race to another thread advancing the same epoch is fine.
+inline void EpochManager::advance() {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	std::uint64_t current = epoch().load();
+	for (Record *r = records().load(std::memory_order_acquire); r != NULL; r = r->next) {
+		std::uint64_t seen = r->epoch.load(std::memory_order_acquire);
+		if (seen != EPOCH_QUIESCENT && seen != current) {
+			return;
+		}
+	}
+	epoch().compare_exchange_strong(current, current + 1);
+}
+
+
+// Frees the objects r retired two or more epochs ago.
+// Every guard that was around when one was retired has ended by then,
+// since the epoch can't pass a guard that hasn't seen it.
+inline void EpochManager::reclaim(Record *r) {
+	std::uint64_t current = epoch().load();
+	std::lock_guard<std::mutex> guard(r->lock);
+	size_t kept = 0;
+	for (Retired &x : r->retired) {
+		if (x.epoch + 2 <= current) {
+			x.deleter(x.context, x.object);
+		}
+		else {
+			r->retired[kept++] = x;
+		}
+	}
+	r->retired.resize(kept);
+}
+
+
+// The global epoch, starting at 0.
+inline std::atomic<std::uint64_t> &EpochManager::epoch() {
+	static std::atomic<std::uint64_t> current(0);
+	return current;
+}
+
+
+// Head of the record list, starting empty.
+inline std::atomic<EpochManager::Record*> &EpochManager::records() {
+	static std::atomic<Record*> head(NULL);
+	return head;
+}
@@ -0,0 +1,121 @@
+/* Epoch Reclamation
+ * Summary:	Frees memory that concurrent readers might still be looking at
+ *			only once they are sure to have moved on. Threads reading shared
+ *			nodes without latches hold an EpochGuard, which notes the global
+ *			epoch in the thread's record. Unlinked nodes are retired into the
+ *			retiring thread's own list, tagged with the epoch. The epoch only
+ *			advances once every guarded thread has seen it, so a node retired
+ *			two epochs ago can't be reached by anyone and is freed.
+ *			Entering and leaving a guard touches only the thread's own record.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Number of nodes a thread retires between attempts to free its list.
+#ifndef BTREE_EPOCH_BATCH
+#define BTREE_EPOCH_BATCH 64
+#endif
+
+// Epoch of a thread that isn't in a guard.
+#define EPOCH_QUIESCENT UINT64_MAX
+
+
+// Keeps the calling thread's reads safe from reclamation while it lives.
+// Guards nest. Only the outermost one in a thread does anything.
+class EpochGuard {
+public:
+	// Constructor
+	// Notes the current epoch in the calling thread's record.
+	// Constant time.
+	EpochGuard();
+
+	// Destructor.
+	// Marks the calling thread quiescent if this was its outermost guard.
+	// Constant time.
+	~EpochGuard();
+
+	EpochGuard(const EpochGuard&) = delete;
+	EpochGuard &operator=(const EpochGuard&) = delete;
+};
+
+
+// The global epoch, and every thread's record of it.
+// Memory is retired with a function that frees it and a context passed to that function,
+// so several owners, such as different trees, can share the epoch.
+class EpochManager {
+public:
+	// Function that frees a retired object. First parameter is the context, second the object.
+	typedef void (*Deleter)(void*, void*);
+
+	// Hands an object that is no longer reachable to the calling thread's retired list.
+	// It is freed once no guard that might have seen it is left.
+	// Every BTREE_EPOCH_BATCH retirements, tries to advance the epoch and free the thread's list.
+	// Constant time, amortized over the frees.
+	static void retire(void*, Deleter, void*);
+
+	// Tries to advance the epoch, and frees the objects in the calling thread's list that are old enough.
+	// Linear time in the number of threads and the length of the list.
+	static void reclaim();
+
+	// Frees at once every retired object, in any thread's list, that has the parameter as its context.
+	// For owners being destroyed, so no reader can still reach their objects.
+	// Linear time in the number of retired objects.
+	static void flush(void*);
+
+private:
+	friend class EpochGuard;
+
+	// An object waiting to be freed.
+	struct Retired {
+		void *object;
+		Deleter deleter;
+		void *context;
+		std::uint64_t epoch;		// Epoch when it was retired.
+	};
+
+	// A thread's state, padded to a cache line so threads never share one.
+	// Records are never freed. A thread's record goes back up for grabs when the thread ends,
+	// along with whatever is still on its retired list.
+	struct alignas(64) Record {
+		std::atomic<std::uint64_t> epoch;	// Epoch the thread's guard saw, or EPOCH_QUIESCENT.
+		std::atomic<bool> taken;			// Whether a thread owns the record.
+		unsigned depth;						// Number of guards the thread is in.
+		std::mutex lock;					// Guards retired, which only flush touches from another thread.
+		std::vector<Retired> retired;
+		Record *next;						// Next record in the list of all records.
+	};
+
+	// Gives a record back when its thread ends.
+	struct Owner {
+		Record *record;
+		~Owner();
+	};
+
+	// The calling thread's record. Taken the first time the thread asks.
+	static Record *record();
+
+	// Takes a record that no thread owns, or adds a new one.
+	static Record *acquire();
+
+	// Advances the epoch if every thread in a guard has seen the current one.
+	static void advance();
+
+	// Frees the objects in a record's list that were retired at least two epochs ago.
+	static void reclaim(Record*);
+
+	// The global epoch.
+	static std::atomic<std::uint64_t> &epoch();
+
+	// Head of the list of all records.
+	static std::atomic<Record*> &records();
+};
+
+
+#include "epoch.cpp"
@@ -0,0 +1,615 @@
+/* Latched B-Tree
+ * Summary:	Lock coupling over a b tree with a latch in every node.
+ */
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+
+using namespace std;
+
+
+// Constructor for latched b trees.
+// t is the minimum degree of the tree.
+// compare is the comparison functor used for ordering keys.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+LatchedBTree<T, Compare, Degree, Optimistic>::LatchedBTree(unsigned t, Compare compare) : tree(t, compare) {
+	if constexpr (Optimistic) {
+		tree.retireNode = &retire;
+		tree.retireContext = this;
+	}
+}
+
+
+// Constructor for latched b trees with a compile-time degree.
+// compare is the comparison functor used for ordering keys.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+LatchedBTree<T, Compare, Degree, Optimistic>::LatchedBTree(Compare compare) : tree(compare) {
+	if constexpr (Optimistic) {
+		tree.retireNode = &retire;
+		tree.retireContext = this;
+	}
+}
+
+
+// Destructor.
+// Frees the nodes this tree retired that are still waiting on their epoch.
+// Nobody can be reading the tree anymore, so there's no need to wait.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+LatchedBTree<T, Compare, Degree, Optimistic>::~LatchedBTree() {
+	if constexpr (Optimistic) {
+		EpochManager::flush(this);
+	}
+}
+
+
+// Inserts a copy of k.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+void LatchedBTree<T, Compare, Degree, Optimistic>::insert(const T &k) {
+	insert(T(k));
+}
+
+
+// Inserts k, moving it into its leaf.
+// Works like BTree::insert from the first node that has to change.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+void LatchedBTree<T, Compare, Degree, Optimistic>::insert(T &&k) {
+	BNode<T, Degree, void, false, void, true> *curr = lockForInsert(k, false);
+
+	// Work down the tree.
+	while (!curr->leaf) {
+		unsigned index = tree.findUpperIndex(curr, k);
+		BNode<T, Degree, void, false, void, true> *next = curr->child[index];
+		next->latch.lock();
+
+		// Split child if full.
+		// The new right half can only be reached through curr, so latching it can't wait.
+		if (next->size == 2 * tree.degree() - 1) {
+			tree.splitChild(curr, index);
+			if (tree.lessThan(curr->key[index], k)) {
+				BNode<T, Degree, void, false, void, true> *sibling = curr->child[index + 1];
+				sibling->latch.lock();
+				next->latch.unlock();
+				next = sibling;
+			}
+		}
+		curr->latch.unlock();
+		curr = next;
+	}
+
+	tree.nodeInsert(curr, std::move(k));
+	curr->latch.unlock();
+}
+
+
+// Inserts a copy of k if no equivalent key is present.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+bool LatchedBTree<T, Compare, Degree, Optimistic>::insertUnique(const T &k) {
+	return insertUnique(T(k));
+}
+
+
+// Inserts k if no equivalent key is present.
+// Works like insert, but checks each node on the way down for k.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+bool LatchedBTree<T, Compare, Degree, Optimistic>::insertUnique(T &&k) {
+	BNode<T, Degree, void, false, void, true> *curr = lockForInsert(k, true);
+	if (curr == NULL) {
+		return false;
+	}
+
+	while (true) {
+		unsigned index = tree.findIndex(curr, k);
+
+		// Found an equivalent key.
+		if (index < curr->size && !tree.lessThan(k, curr->key[index])) {
+			curr->latch.unlock();
+			return false;
+		}
+
+		// Insert at the bottom of the tree.
+		if (curr->leaf) {
+			tree.nodeInsertAt(curr, index, std::move(k));
+			curr->latch.unlock();
+			return true;
+		}
+
+		// Split child if full. The key moved up may be the one we're looking for.
+		BNode<T, Degree, void, false, void, true> *next = curr->child[index];
+		next->latch.lock();
+		if (next->size == 2 * tree.degree() - 1) {
+			tree.splitChild(curr, index);
+			if (tree.lessThan(curr->key[index], k)) {
+				BNode<T, Degree, void, false, void, true> *sibling = curr->child[index + 1];
+				sibling->latch.lock();
+				next->latch.unlock();
+				next = sibling;
+			}
+			else if (!tree.lessThan(k, curr->key[index])) {
+				next->latch.unlock();
+				curr->latch.unlock();
+				return false;
+			}
+		}
+		curr->latch.unlock();
+		curr = next;
+	}
+}
+
+
+// Removes k from the tree if it is present.
+// Works like BTree::erase from the first node that has to change, fixing each child before moving into it.
+// If the root latch is held, it is let go once the first level is done.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+bool LatchedBTree<T, Compare, Degree, Optimistic>::erase(const T &k, T *out) {
+	bool holdingRoot;
+	BNode<T, Degree, void, false, void, true> *curr = lockForErase(k, holdingRoot);
+	if (curr == NULL) {
+		return false;
+	}
+
+	while (true) {
+		unsigned i = tree.findIndex(curr, k);
+		bool found = i < curr->size && !(tree.lessThan(curr->key[i], k) || tree.lessThan(k, curr->key[i]));
+		BNode<T, Degree, void, false, void, true> *next;
+
+		// At a leaf, delete the key if it's here.
+		if (curr->leaf) {
+			if (found) {
+				T removed = tree.nodeDelete(curr, i);
+				if (out != NULL) {
+					*out = std::move(removed);
+				}
+			}
+			curr->latch.unlock();
+			if (holdingRoot) {
+				rootLatch.unlock();
+			}
+			return found;
+		}
+
+		// Otherwise replace with predecessor/successor or merge children.
+		else if (found) {
+			BNode<T, Degree, void, false, void, true> *leftKid = curr->child[i];
+			BNode<T, Degree, void, false, void, true> *rightKid = curr->child[i + 1];
+			leftKid->latch.lock();
+
+			// Replace with predecessor. curr stays latched until its key is replaced.
+			if (leftKid->size >= tree.degree()) {
+				while (!leftKid->leaf) {
+					BNode<T, Degree, void, false, void, true> *kid = fixChild(leftKid, leftKid->size);
+					leftKid->latch.unlock();
+					leftKid = kid;
+				}
+				if (out != NULL) {
+					*out = std::move(curr->key[i]);
+				}
+				tree.moveEntry(curr, i, leftKid, leftKid->size - 1);
+				tree.nodeClose(leftKid, leftKid->size - 1);
+				leftKid->latch.unlock();
+				curr->latch.unlock();
+				if (holdingRoot) {
+					rootLatch.unlock();
+				}
+				return true;
+			}
+
+			// Replace with successor
+			rightKid->latch.lock();
+			if (rightKid->size >= tree.degree()) {
+				leftKid->latch.unlock();
+				while (!rightKid->leaf) {
+					BNode<T, Degree, void, false, void, true> *kid = fixChild(rightKid, 0);
+					rightKid->latch.unlock();
+					rightKid = kid;
+				}
+				if (out != NULL) {
+					*out = std::move(curr->key[i]);
+				}
+				tree.moveEntry(curr, i, rightKid, 0);
+				tree.nodeClose(rightKid, 0);
+				rightKid->latch.unlock();
+				curr->latch.unlock();
+				if (holdingRoot) {
+					rootLatch.unlock();
+				}
+				return true;
+			}
+
+			// Merge children and move down the tree.
+			// rightKid is freed with its latch held. Nothing else can reach it while curr is latched.
+			if (tree.mergeChildren(curr, i) != NEW_ROOT) {
+				curr->latch.unlock();
+			}
+			next = leftKid;
+		}
+
+		// If the item has not been found, move down the tree.
+		// If the root's children merged, the root was freed and must not be unlatched.
+		else {
+			next = fixChild(curr, i);
+			if (!holdingRoot || tree.root == curr) {
+				curr->latch.unlock();
+			}
+		}
+
+		if (holdingRoot) {
+			rootLatch.unlock();
+			holdingRoot = false;
+		}
+		curr = next;
+	}
+}
+
+
+// Copy of the key equivalent to k, if there is one.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+optional<T> LatchedBTree<T, Compare, Degree, Optimistic>::find(const T &k) {
+	optional<T> found;
+	lookup(k, [&found](const T &key) {
+		found.emplace(key);
+	});
+	return found;
+}
+
+
+// Whether a key equivalent to k is present.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+bool LatchedBTree<T, Compare, Degree, Optimistic>::contains(const T &k) {
+	return lookup(k, [](const T&) {});
+}
+
+
+// Searches for k, latching each node shared and letting go of its parent.
+// Optimistic trees instead read each node between taking and validating its version.
+// A child's version is taken before the parent is validated, so the child is known to
+// still be the parent's child, and the search starts over if any validation fails.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+template <typename F>
+bool LatchedBTree<T, Compare, Degree, Optimistic>::lookup(const T &k, F f) {
+	if constexpr (Optimistic) {
+		EpochGuard guard;
+		BNode<T, Degree, void, false, void, true> *curr = NULL;
+		uint64_t version = 0;
+		while (true) {
+
+			// Start, or start over, at the root.
+			if (curr == NULL) {
+				uint64_t rootVersion = rootLatch.readVersion();
+				curr = tree.root;
+				version = curr->latch.readVersion();
+				if (!rootLatch.validate(rootVersion)) {
+					curr = NULL;
+					continue;
+				}
+			}
+
+			unsigned i = tree.findIndex(curr, k);
+			if (i < curr->size && !tree.lessThan(k, curr->key[i])) {
+				T found = curr->key[i];
+				if (!curr->latch.validate(version)) {
+					curr = NULL;
+					continue;
+				}
+				f(found);
+				return true;
+			}
+			if (curr->leaf) {
+				if (!curr->latch.validate(version)) {
+					curr = NULL;
+					continue;
+				}
+				return false;
+			}
+			BNode<T, Degree, void, false, void, true> *next = curr->child[i];
+			if (!curr->latch.validate(version)) {
+				curr = NULL;
+				continue;
+			}
+			uint64_t nextVersion = next->latch.readVersion();
+			if (!curr->latch.validate(version)) {
+				curr = NULL;
+				continue;
+			}
+			curr = next;
+			version = nextVersion;
+		}
+	}
+	else {
+		BNode<T, Degree, void, false, void, true> *curr = lockRootShared();
+		while (true) {
+			unsigned i = tree.findIndex(curr, k);
+			if (i < curr->size && !tree.lessThan(k, curr->key[i])) {
+				f(curr->key[i]);
+				curr->latch.unlock_shared();
+				return true;
+			}
+			if (curr->leaf) {
+				curr->latch.unlock_shared();
+				return false;
+			}
+			BNode<T, Degree, void, false, void, true> *next = curr->child[i];
+			next->latch.lock_shared();
+			curr->latch.unlock_shared();
+			curr = next;
+		}
+	}
+}
+
+
+// Latches the root shared.
+// The root latch is held just long enough that the root can't be replaced before it is latched.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+BNode<T, Degree, void, false, void, true> *LatchedBTree<T, Compare, Degree, Optimistic>::lockRootShared() {
+	rootLatch.lock_shared();
+	BNode<T, Degree, void, false, void, true> *r = tree.root;
+	r->latch.lock_shared();
+	rootLatch.unlock_shared();
+	return r;
+}
+
+
+// Latches the root exclusively, growing the tree upwards if the root is full.
+// The root latch is kept until the root can't split.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+BNode<T, Degree, void, false, void, true> *LatchedBTree<T, Compare, Degree, Optimistic>::lockRootForInsert() {
+	rootLatch.lock();
+	BNode<T, Degree, void, false, void, true> *curr = tree.root;
+	curr->latch.lock();
+	if (curr->size == 2 * tree.degree() - 1) {
+		BNode<T, Degree, void, false, void, true> *newRoot = tree.newNode();
+		newRoot->leaf = false;
+		newRoot->child[0] = curr;
+		newRoot->latch.lock();
+		tree.splitChild(newRoot, 0);
+		tree.root = newRoot;
+		curr->latch.unlock();
+		curr = newRoot;
+	}
+	rootLatch.unlock();
+	return curr;
+}
+
+
+// Finds the node an insert of k starts changing things at, and latches it.
+// Optimistic trees read down until the next child is full or they reach a leaf,
+// and then upgrade to an exclusive latch on the node they're at. Its version shows it
+// hasn't changed since it was read, so it still isn't full and is still where k goes.
+// A full root is left to lockRootForInsert.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+BNode<T, Degree, void, false, void, true> *LatchedBTree<T, Compare, Degree, Optimistic>::lockForInsert(const T &k, bool unique) {
+	if constexpr (Optimistic) {
+		EpochGuard guard;
+		BNode<T, Degree, void, false, void, true> *curr = NULL;
+		uint64_t version = 0;
+		while (true) {
+
+			// Start, or start over, at the root.
+			if (curr == NULL) {
+				uint64_t rootVersion = rootLatch.readVersion();
+				curr = tree.root;
+				version = curr->latch.readVersion();
+				if (!rootLatch.validate(rootVersion)) {
+					curr = NULL;
+					continue;
+				}
+				if (curr->size == 2 * tree.degree() - 1) {
+					if (!curr->latch.validate(version)) {
+						curr = NULL;
+						continue;
+					}
+					return lockRootForInsert();
+				}
+			}
+
+			unsigned index = unique ? tree.findIndex(curr, k) : tree.findUpperIndex(curr, k);
+			if (unique && index < curr->size && !tree.lessThan(k, curr->key[index])) {
+				if (!curr->latch.validate(version)) {
+					curr = NULL;
+					continue;
+				}
+				return NULL;
+			}
+
+			// Look at the next child, and stop here if it has to be split.
+			bool stop = curr->leaf;
+			if (!stop) {
+				BNode<T, Degree, void, false, void, true> *next = curr->child[index];
+				if (!curr->latch.validate(version)) {
+					curr = NULL;
+					continue;
+				}
+				uint64_t nextVersion = next->latch.readVersion();
+				stop = next->size == 2 * tree.degree() - 1;
+				if (!next->latch.validate(nextVersion) || !curr->latch.validate(version)) {
+					curr = NULL;
+					continue;
+				}
+				if (!stop) {
+					curr = next;
+					version = nextVersion;
+					continue;
+				}
+			}
+
+			if (curr->latch.tryUpgrade(version)) {
+				return curr;
+			}
+			curr = NULL;
+		}
+	}
+	else {
+		(void) k;
+		(void) unique;
+		return lockRootForInsert();
+	}
+}
+
+
+// Latches the root exclusively for an erase.
+// The root is only replaced when its one key is merged down into its children,
+// so the root latch is let go right away unless the root has one key.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+BNode<T, Degree, void, false, void, true> *LatchedBTree<T, Compare, Degree, Optimistic>::lockRootForErase(bool &holdingRoot) {
+	rootLatch.lock();
+	BNode<T, Degree, void, false, void, true> *curr = tree.root;
+	curr->latch.lock();
+	holdingRoot = !curr->leaf && curr->size == 1;
+	if (!holdingRoot) {
+		rootLatch.unlock();
+	}
+	return curr;
+}
+
+
+// Finds the node an erase of k starts changing things at, and latches it.
+// Optimistic trees read down until they find k, reach a leaf, or the next child
+// is too small, and then upgrade to an exclusive latch on the node they're at.
+// A root that could be merged away is left to lockRootForErase.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+BNode<T, Degree, void, false, void, true> *LatchedBTree<T, Compare, Degree, Optimistic>::lockForErase(const T &k, bool &holdingRoot) {
+	if constexpr (Optimistic) {
+		EpochGuard guard;
+		holdingRoot = false;
+		BNode<T, Degree, void, false, void, true> *curr = NULL;
+		uint64_t version = 0;
+		bool atRoot = false;
+		while (true) {
+
+			// Start, or start over, at the root.
+			if (curr == NULL) {
+				uint64_t rootVersion = rootLatch.readVersion();
+				curr = tree.root;
+				version = curr->latch.readVersion();
+				if (!rootLatch.validate(rootVersion)) {
+					curr = NULL;
+					continue;
+				}
+				atRoot = true;
+			}
+
+			unsigned i = tree.findIndex(curr, k);
+			bool found = i < curr->size && !(tree.lessThan(curr->key[i], k) || tree.lessThan(k, curr->key[i]));
+
+			// A key that isn't in its leaf isn't in the tree.
+			if (curr->leaf && !found) {
+				if (!curr->latch.validate(version)) {
+					curr = NULL;
+					continue;
+				}
+				return NULL;
+			}
+
+			// Look at the next child, and stop here if it has to be fixed.
+			if (!curr->leaf && !found) {
+				BNode<T, Degree, void, false, void, true> *next = curr->child[i];
+				if (!curr->latch.validate(version)) {
+					curr = NULL;
+					continue;
+				}
+				uint64_t nextVersion = next->latch.readVersion();
+				bool small = next->size < tree.degree();
+				if (!next->latch.validate(nextVersion) || !curr->latch.validate(version)) {
+					curr = NULL;
+					continue;
+				}
+				if (!small) {
+					curr = next;
+					version = nextVersion;
+					atRoot = false;
+					continue;
+				}
+			}
+
+			if (atRoot && !curr->leaf && curr->size == 1) {
+				if (!curr->latch.validate(version)) {
+					curr = NULL;
+					continue;
+				}
+				return lockRootForErase(holdingRoot);
+			}
+			if (curr->latch.tryUpgrade(version)) {
+				return curr;
+			}
+			curr = NULL;
+		}
+	}
+	else {
+		(void) k;
+		return lockRootForErase(holdingRoot);
+	}
+}
+
+
+// Unlatches x for good, marking it obsolete so optimistic readers on it start over,
+// and hands it to the epoch manager to free once those readers are gone.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+void LatchedBTree<T, Compare, Degree, Optimistic>::retire(void *self, BNode<T, Degree, void, false, void, true> *x) {
+	x->latch.unlockObsolete();
+	EpochManager::retire(x, &reclaimNode, self);
+}
+
+
+// Destroys the keys of a retired node and returns its block to the pool.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+void LatchedBTree<T, Compare, Degree, Optimistic>::reclaimNode(void *self, void *x) {
+	LatchedBTree<T, Compare, Degree, Optimistic> *owner = (LatchedBTree<T, Compare, Degree, Optimistic>*) self;
+	owner->tree.destroyNode((BNode<T, Degree, void, false, void, true>*) x);
+	owner->tree.pool.deallocate(x);
+}
+
+
+// Latches parent->child[index] and gives it at least degree() keys.
+// Each sibling is latched only to check or change it, so at most parent, the child, and one sibling are held.
+// A sibling that was checked and let go can't change before it is latched again,
+// since nothing can reach it without going through parent.
+// A child merged into its left sibling is freed with its latch held, which is safe for the same reason.
+template <typename T, typename Compare, unsigned Degree, bool Optimistic>
+BNode<T, Degree, void, false, void, true> *LatchedBTree<T, Compare, Degree, Optimistic>::fixChild(BNode<T, Degree, void, false, void, true> *parent, unsigned index) {
+	BNode<T, Degree, void, false, void, true> *kid = parent->child[index];
+	kid->latch.lock();
+	if (kid->size >= tree.degree()) {
+		return kid;
+	}
+
+	// Borrow from left sibling if possible.
+	if (index != 0) {
+		BNode<T, Degree, void, false, void, true> *leftKid = parent->child[index - 1];
+		leftKid->latch.lock();
+		if (leftKid->size >= tree.degree()) {
+			tree.rotateFromLeft(parent, index);
+			leftKid->latch.unlock();
+			return kid;
+		}
+		if (index == parent->size) {
+			tree.mergeChildren(parent, index - 1);
+			return leftKid;
+		}
+		leftKid->latch.unlock();
+	}
+
+	// Borrow from right sibling if possible
+	BNode<T, Degree, void, false, void, true> *rightKid = parent->child[index + 1];
+	rightKid->latch.lock();
+	if (rightKid->size >= tree.degree()) {
+		tree.rotateFromRight(parent, index);
+		rightKid->latch.unlock();
+		return kid;
+	}
+
+	// If borrowing is not possible, then merge, into the left sibling if there is one.
+	if (index != 0) {
+		rightKid->latch.unlock();
+		BNode<T, Degree, void, false, void, true> *leftKid = parent->child[index - 1];
+		leftKid->latch.lock();
+		tree.mergeChildren(parent, index - 1);
+		return leftKid;
+	}
+	tree.mergeChildren(parent, index);
+	return kid;
+}
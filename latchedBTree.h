@@ -0,0 +1,136 @@
+/* Latched B-Tree
+ * Summary:	A b tree that threads can search and change at the same time.
+ *			Every node has a latch, and operations crab down the tree: a child's
+ *			latch is taken before its parent's is let go. Since inserts split full
+ *			nodes and erases fill up small nodes on the way down, a writer never
+ *			goes back up, so it only holds the latches around where it is.
+ *			Writers in different subtrees run in parallel.
+ *			In optimistic mode, readers take no latches. They check node versions
+ *			instead and start over if a node changed under them, and writers
+ *			read optimistically down to the first node they have to change.
+ *			Nodes that optimistic readers might still be on are freed by epoch.
+ *			Most standard operations run in O(lg(n)) time.
+ */
+
+
+#pragma once
+
+#include <optional>
+#include <type_traits>
+
+#include "bTree.h"
+#include "epoch.h"
+#include "nodeLatch.h"
+
+
+// class for representing b trees that threads share with per-node latches.
+// Compare and Degree work as they do for BTree.
+// Optimistic is whether lookups, and writers above the nodes they change, validate versions instead of latching.
+// Keys of optimistic trees must be trivially copyable, since they may be copied while being written,
+// and Compare must be safe to call on such torn keys; the result is thrown away when validation fails.
+// Nodes unlinked from an optimistic tree are freed through the epoch manager once no reader can still see them.
+// Latches are always taken from the root down, so threads can't deadlock.
+// Siblings are latched only while their parent is held exclusively, in either order.
+// Nobody else can reach them without going through that parent, since optimistic
+// writers only try to upgrade, which fails once the parent's version has moved.
+// Nothing returned points into the tree. Keys are copied out instead.
+template <typename T, typename Compare = std::less<T>, unsigned Degree = DYNAMIC_DEGREE, bool Optimistic = false>
+class LatchedBTree {
+	static_assert(!Optimistic || std::is_trivially_copyable<T>::value, "optimistic trees need trivially copyable keys");
+
+public:
+	// Constructor
+	// First parameter is the minimum degree of the tree.
+	// It is ignored if the tree has a compile-time degree.
+	// Second parameter is the tree's key-comparison functor.
+	// Constant time.
+	LatchedBTree(unsigned, Compare = defaultCompare<Compare>());
+
+	// Constructor for trees with a compile-time degree.
+	// First parameter is the tree's key-comparison functor.
+	// Constant time.
+	LatchedBTree(Compare = defaultCompare<Compare>());
+
+	// Destructor.
+	// Frees the tree's retired nodes without waiting for their epoch.
+	~LatchedBTree();
+
+	// Inserts a key into the tree.
+	// Holds at most a node and its child exclusively at a time.
+	// Logorithmic time.
+	void insert(const T&);
+	void insert(T&&);
+
+	// Inserts a key if no equivalent key is in the tree.
+	// Returns whether it was inserted.
+	// Logorithmic time.
+	bool insertUnique(const T&);
+	bool insertUnique(T&&);
+
+	// Removes a key equivalent to the first parameter.
+	// If the second parameter isn't NULL, the removed key is moved into it.
+	// Returns whether a key was removed.
+	// Holds a node, its child, and one of the child's siblings exclusively while rebalancing,
+	// and also the node whose key is being replaced while finding its predecessor or successor.
+	// Logorithmic time.
+	bool erase(const T&, T* = NULL);
+
+	// Copy of the key equivalent to the parameter, or nothing if there is none.
+	// Holds at most a node and its child shared at a time, or no latches if Optimistic.
+	// Logorithmic time.
+	std::optional<T> find(const T&);
+
+	// Whether a key equivalent to the parameter is in the tree.
+	// Logorithmic time.
+	bool contains(const T&);
+
+private:
+
+	// Searches for a key with shared latches, and calls a function on it while its node is still latched.
+	// Optimistic trees call the function on a validated copy of the key instead.
+	// Returns whether the key was found.
+	template <typename F>
+	bool lookup(const T&, F);
+
+	// Latches the root shared and returns it.
+	BNode<T, Degree, void, false, void, true> *lockRootShared();
+
+	// Latches the root exclusively for an insert, first growing the tree if the root is full.
+	BNode<T, Degree, void, false, void, true> *lockRootForInsert();
+
+	// Latches exclusively the highest node an insert of a key has to change, which isn't full.
+	// Nodes above it are read optimistically if the tree is Optimistic. Otherwise it is the root.
+	// If the second parameter is true, returns NULL instead if an equivalent key is seen.
+	BNode<T, Degree, void, false, void, true> *lockForInsert(const T&, bool);
+
+	// Latches the root exclusively for an erase.
+	// Sets the parameter to whether the root latch is still held, because the root might be merged away.
+	BNode<T, Degree, void, false, void, true> *lockRootForErase(bool&);
+
+	// Latches exclusively the highest node an erase of a key has to change, which has at least minDegree keys unless it is the root.
+	// Nodes above it are read optimistically if the tree is Optimistic. Otherwise it is the root.
+	// Sets the second parameter as lockRootForErase does.
+	// Returns NULL instead if the tree is Optimistic and the key was found to be missing.
+	BNode<T, Degree, void, false, void, true> *lockForErase(const T&, bool&);
+
+	// Marks a node unlinked from an optimistic tree obsolete and retires it. Set as the tree's retireNode.
+	// First parameter is the tree. The node must be latched exclusively.
+	static void retire(void*, BNode<T, Degree, void, false, void, true>*);
+
+	// Frees a retired node. Called by the epoch manager with the tree as the first parameter.
+	static void reclaimNode(void*, void*);
+
+	// Latches a child exclusively and makes sure it has at least minDegree keys, as BTree::fixChildSize.
+	// The node must be latched exclusively. Latches its children's siblings as needed.
+	// Returns the latched node that now holds the child's keys, which is a sibling if they merged.
+	BNode<T, Degree, void, false, void, true> *fixChild(BNode<T, Degree, void, false, void, true>*, unsigned);
+
+	// Guards the tree's root pointer. Held until the root is latched and can't be replaced.
+	NodeLatch rootLatch;
+
+	// The tree. Its nodes are latched and come from a shared pool.
+	BTree<T, Compare, Degree, std::allocator<char>, false, void, void, true> tree;
+};
+
+
+#include "latchedBTree.cpp"
@@ -0,0 +1,98 @@
+/* Node Latch
+ * Summary:	Reader-writer latch packed into one word.
+ */
+
+
+#pragma once
+
+
+// Constructor for node latches.
+inline NodeLatch::NodeLatch() : word(0) {}
+
+
+// Takes the latch exclusively.
+// Waits for readers to leave, marking the latch so that no more come in meanwhile.
+inline void NodeLatch::lock() {
+	std::uint64_t w = word.load(std::memory_order_relaxed);
+	while (true) {
+		if ((w & (LATCH_EXCLUSIVE | LATCH_READERS)) == 0) {
+			if (word.compare_exchange_weak(w, (w | LATCH_EXCLUSIVE) & ~LATCH_WAITING, std::memory_order_acquire, std::memory_order_relaxed)) {
+				return;
+			}
+			continue;
+		}
+		if ((w & LATCH_WAITING) == 0) {
+			word.fetch_or(LATCH_WAITING, std::memory_order_relaxed);
+		}
+		std::this_thread::yield();
+		w = word.load(std::memory_order_relaxed);
+	}
+}
+
+
+// Releases an exclusive latch.
+// Clears the exclusive bit and adds a version in one step.
+inline void NodeLatch::unlock() {
+	word.fetch_add(LATCH_VERSION - LATCH_EXCLUSIVE, std::memory_order_release);
+}
+
+
+// Takes the latch shared.
+// Holds off while a writer has the latch or is waiting for it.
+inline void NodeLatch::lock_shared() {
+	std::uint64_t w = word.load(std::memory_order_relaxed);
+	while (true) {
+		if ((w & (LATCH_EXCLUSIVE | LATCH_WAITING)) == 0) {
+			if (word.compare_exchange_weak(w, w + LATCH_READER, std::memory_order_acquire, std::memory_order_relaxed)) {
+				return;
+			}
+			continue;
+		}
+		std::this_thread::yield();
+		w = word.load(std::memory_order_relaxed);
+	}
+}
+
+
+// Releases a shared latch.
+inline void NodeLatch::unlock_shared() {
+	word.fetch_sub(LATCH_READER, std::memory_order_release);
+}
+
+
+// Returns the version once the latch isn't held exclusively.
+// Reader counts and the waiting bit are masked off, since they don't mean the node changed.
+inline std::uint64_t NodeLatch::readVersion() const {
+	std::uint64_t w = word.load(std::memory_order_acquire);
+	while (w & LATCH_EXCLUSIVE) {
+		std::this_thread::yield();
+		w = word.load(std::memory_order_acquire);
+	}
+	return w & ~(LATCH_WAITING | LATCH_READERS);
+}
+
+
+// Checks version v against the latch.
+// The fence keeps the reads being validated from moving after the check.
+inline bool NodeLatch::validate(std::uint64_t v) const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return (word.load(std::memory_order_relaxed) & ~(LATCH_WAITING | LATCH_READERS)) == v && (v & LATCH_OBSOLETE) == 0;
+}
+
+
+// Takes the latch exclusively if it is at version v and has no readers.
+inline bool NodeLatch::tryUpgrade(std::uint64_t v) {
+	std::uint64_t w = word.load(std::memory_order_relaxed);
+	while ((w & ~(LATCH_WAITING | LATCH_READERS)) == v && (w & LATCH_READERS) == 0 && (v & LATCH_OBSOLETE) == 0) {
+		if (word.compare_exchange_weak(w, w | LATCH_EXCLUSIVE, std::memory_order_acquire, std::memory_order_relaxed)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// Releases an exclusive latch and sets the obsolete bit, advancing the version.
+inline void NodeLatch::unlockObsolete() {
+	word.fetch_add(LATCH_VERSION - LATCH_EXCLUSIVE + LATCH_OBSOLETE, std::memory_order_release);
+}
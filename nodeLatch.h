@@ -0,0 +1,74 @@
+/* Node Latch
+ * Summary:	A reader-writer latch small enough to embed in every b tree node.
+ *			The whole latch is one 64-bit word, holding the exclusive bit,
+ *			a bit for a waiting writer, the number of readers, and a version
+ *			that goes up each time an exclusive holder lets go.
+ *			Waiting spins, yielding the thread between attempts.
+ *			Optimistic readers take no latch at all. They note the version,
+ *			read, and then check that the version hasn't moved.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// Fields of a latch word.
+#define LATCH_EXCLUSIVE 1ULL				// Set while a writer holds the latch.
+#define LATCH_WAITING 2ULL					// Set while a writer waits. Keeps new readers out.
+#define LATCH_READER 4ULL					// One reader. Readers are counted in bits 2 to 30.
+#define LATCH_READERS 0x7FFFFFFCULL			// Mask of the reader count.
+#define LATCH_OBSOLETE (1ULL << 31)			// Set once the node is unlinked. Validation always fails after.
+#define LATCH_VERSION (1ULL << 32)			// One version. Versions are kept in bits 32 to 63.
+
+
+// Reader-writer latch in one word.
+// Meets the SharedMutex requirements used by std::shared_lock and std::unique_lock.
+// Not recursive, and a shared latch can't be upgraded.
+class NodeLatch {
+public:
+	// Constructor
+	// Starts unlatched at version 0.
+	NodeLatch();
+
+	NodeLatch(const NodeLatch&) = delete;
+	NodeLatch &operator=(const NodeLatch&) = delete;
+
+	// Takes the latch exclusively.
+	void lock();
+
+	// Releases an exclusive latch and advances the version.
+	void unlock();
+
+	// Takes the latch shared.
+	void lock_shared();
+
+	// Releases a shared latch.
+	void unlock_shared();
+
+	// Waits for any exclusive holder to let go and returns the version to validate against.
+	// Reading the node afterwards takes no latch, so it may see changes in progress.
+	std::uint64_t readVersion() const;
+
+	// Whether nobody has held the latch exclusively since the version was read,
+	// so everything read in between was consistent.
+	bool validate(std::uint64_t) const;
+
+	// Takes the latch exclusively if it is still at the version, without waiting.
+	// Returns whether it did.
+	bool tryUpgrade(std::uint64_t);
+
+	// Releases an exclusive latch for good, marking the node unlinked so that
+	// optimistic readers still looking at it start over.
+	void unlockObsolete();
+
+private:
+
+	// Exclusive, waiting and obsolete bits, reader count and version.
+	std::atomic<std::uint64_t> word;
+};
+
+
+#include "nodeLatch.cpp"
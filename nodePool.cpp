@@ -0,0 +1,91 @@
+/* Node Pool
+ * Summary:	Slab and free list allocation of fixed-size blocks.
+ */
+
+
+#pragma once
+
+
+// Constructor for a pool with no slabs yet.
+template <typename Alloc, std::size_t Align, bool Shared>
+NodePool<Alloc, Align, Shared>::NodePool(const Alloc &a) : alloc(a), slabs(NULL), freeList(NULL), bump(NULL), bumpEnd(NULL), blockSize(Align), slabBlocks(1) {}
+
+
+// Destructor.
+template <typename Alloc, std::size_t Align, bool Shared>
+NodePool<Alloc, Align, Shared>::~NodePool() {
+	release();
+}
+
+
+// Sets the block size.
+template <typename Alloc, std::size_t Align, bool Shared>
+void NodePool<Alloc, Align, Shared>::init(std::size_t bytes) {
+	blockSize = (bytes + Align - 1) / Align * Align;
+	slabBlocks = 1;
+}
+
+
+// Pops a block off the free list, or carves the next one out of the newest slab.
+template <typename Alloc, std::size_t Align, bool Shared>
+inline void *NodePool<Alloc, Align, Shared>::allocate() {
+	std::lock_guard<Lock> guard(lock);
+	if (freeList != NULL) {
+		void *block = freeList;
+		freeList = *(void**) block;
+		return block;
+	}
+	if (bump == bumpEnd) {
+		grow();
+	}
+	void *block = bump;
+	bump += blockSize;
+	return block;
+}
+
+
+// Pushes a block onto the free list.
+template <typename Alloc, std::size_t Align, bool Shared>
+inline void NodePool<Alloc, Align, Shared>::deallocate(void *block) {
+	std::lock_guard<Lock> guard(lock);
+	*(void**) block = freeList;
+	freeList = block;
+}
+
+
+// Gives every slab back to the allocator and forgets all blocks.
+template <typename Alloc, std::size_t Align, bool Shared>
+void NodePool<Alloc, Align, Shared>::release() {
+	while (slabs != NULL) {
+		Slab *next = slabs->next;
+		std::allocator_traits<CharAlloc>::deallocate(alloc, (char*) slabs, slabs->bytes);
+		slabs = next;
+	}
+	freeList = NULL;
+	bump = NULL;
+	bumpEnd = NULL;
+	slabBlocks = 1;
+}
+
+
+// Allocates a slab twice the size of the last one, up to BTREE_POOL_MAX_SLAB.
+// The allocator may not align to Align, so each slab has room to align its first block.
+// Whatever was left of the previous slab is too small for a block and is skipped.
+template <typename Alloc, std::size_t Align, bool Shared>
+void NodePool<Alloc, Align, Shared>::grow() {
+	std::size_t bytes = sizeof(Slab) + Align - 1 + slabBlocks * blockSize;
+	char *raw = std::allocator_traits<CharAlloc>::allocate(alloc, bytes);
+
+	Slab *slab = (Slab*) raw;
+	slab->next = slabs;
+	slab->bytes = bytes;
+	slabs = slab;
+
+	std::size_t start = ((std::size_t) raw + sizeof(Slab) + Align - 1) / Align * Align;
+	bump = (char*) start;
+	bumpEnd = bump + slabBlocks * blockSize;
+
+	if (slabBlocks < 16 || 2 * slabBlocks * blockSize <= BTREE_POOL_MAX_SLAB) {
+		slabBlocks *= 2;
+	}
+}
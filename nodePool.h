@@ -0,0 +1,105 @@
+/* Node Pool
+ * Summary:	Hands out fixed-size, cache-line-aligned blocks for b tree nodes.
+ *			Blocks are carved out of large slabs in order, and freed blocks go on
+ *			a free list to be reused, so allocating or freeing a node is a pointer
+ *			bump or a list pop or push. Slabs are only released when the pool is.
+ *			Slabs come from an allocator, std::allocator<char> by default.
+ *			A shared pool takes a mutex around each allocation and free.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+// Largest slab a pool grows to, in bytes.
+// Slabs start small and double until they reach this size, or fit 16 blocks.
+#ifndef BTREE_POOL_MAX_SLAB
+#define BTREE_POOL_MAX_SLAB (1 << 20)
+#endif
+
+
+// Pool of equally sized blocks aligned to Align bytes.
+// Alloc is any allocator. It is rebound to allocate slabs of char.
+// Shared is whether several threads may allocate and free blocks at once.
+template <typename Alloc = std::allocator<char>, std::size_t Align = 64, bool Shared = false>
+class NodePool {
+public:
+	// Constructor
+	// Parameter is the allocator to get slabs from.
+	// init must be called before the first allocation.
+	NodePool(const Alloc& = Alloc());
+
+	// Destructor.
+	// Releases every slab. Blocks still in use must have been cleaned up already.
+	~NodePool();
+
+	NodePool(const NodePool&) = delete;
+	NodePool &operator=(const NodePool&) = delete;
+
+	// Sets the size of the blocks, which is rounded up to a multiple of Align.
+	// Constant time.
+	void init(std::size_t);
+
+	// Returns an uninitialized block.
+	// Thread safe if the pool is Shared.
+	// Constant time, amortized over slab allocations.
+	void *allocate();
+
+	// Returns a block to the free list.
+	// Thread safe if the pool is Shared.
+	// Constant time.
+	void deallocate(void*);
+
+	// Releases every slab at once, freeing all blocks without visiting them.
+	// Never thread safe.
+	// Linear in the number of slabs.
+	void release();
+
+private:
+	typedef typename std::allocator_traits<Alloc>::template rebind_alloc<char> CharAlloc;
+
+	// Header at the start of each slab. Slabs form a singly linked list.
+	struct Slab {
+		Slab *next;				// Previously allocated slab.
+		std::size_t bytes;		// Size of the slab's allocation.
+	};
+
+	// Stand-in for a mutex in pools that aren't Shared.
+	struct NoLock {
+		void lock() {}
+		void unlock() {}
+	};
+	typedef typename std::conditional<Shared, std::mutex, NoLock>::type Lock;
+
+	// Allocates a new slab and makes its blocks the ones handed out next.
+	void grow();
+
+	// Allocator slabs come from.
+	CharAlloc alloc;
+
+	// Most recently allocated slab.
+	Slab *slabs;
+
+	// Freed blocks. Each one holds a pointer to the next.
+	void *freeList;
+
+	// Unused part of the newest slab, which blocks are carved from in order.
+	char *bump;
+	char *bumpEnd;
+
+	// Size in bytes of each block.
+	std::size_t blockSize;
+
+	// Number of blocks the next slab will hold.
+	std::size_t slabBlocks;
+
+	// Held while allocating or freeing a block.
+	Lock lock;
+};
+
+
+#include "nodePool.cpp"
@@ -0,0 +1,102 @@
+/* SIMD Key Search
+ * Summary:	Vector and scalar kernels for counting keys below a search key.
+ */
+
+
+#pragma once
+
+
+#ifdef BTREE_SIMD_X86
+#include <immintrin.h>
+#endif
+#include <stdint.h>
+
+
+// Scalar version of simdCountKeys.
+// Counts without branching so the compiler is free to vectorize the loop itself.
+template <bool Upper, typename T>
+inline unsigned scalarCountKeys(const T *keys, unsigned n, T k) {
+	unsigned count = 0;
+	for (unsigned i = 0; i < n; i++) {
+		count += Upper ? !(k < keys[i]) : keys[i] < k;
+	}
+	return count;
+}
+
+
+#ifdef BTREE_SIMD_X86
+
+// Whether the CPU running the program supports AVX2.
+// Checked once and then cached.
+inline bool cpuHasAvx2() {
+	static const bool hasAvx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+	return hasAvx2;
+}
+
+
+// AVX2 version of simdCountKeys.
+// Compares 8 4-byte keys or 4 8-byte keys per instruction and counts matches with popcount.
+// Unsigned integers are compared as signed after flipping their sign bits.
+template <bool Upper, typename T>
+__attribute__((target("avx2,popcnt")))
+unsigned avx2CountKeys(const T *keys, unsigned n, T k) {
+	unsigned count = 0;
+	unsigned i = 0;
+
+	if constexpr (std::is_same<T, float>::value) {
+		__m256 kv = _mm256_set1_ps(k);
+		for (; i + 8 <= n; i += 8) {
+			__m256 v = _mm256_loadu_ps(keys + i);
+			__m256 m = Upper ? _mm256_cmp_ps(v, kv, _CMP_NGT_UQ) : _mm256_cmp_ps(v, kv, _CMP_LT_OQ);
+			count += __builtin_popcount(_mm256_movemask_ps(m));
+		}
+	}
+	else if constexpr (std::is_same<T, double>::value) {
+		__m256d kv = _mm256_set1_pd(k);
+		for (; i + 4 <= n; i += 4) {
+			__m256d v = _mm256_loadu_pd(keys + i);
+			__m256d m = Upper ? _mm256_cmp_pd(v, kv, _CMP_NGT_UQ) : _mm256_cmp_pd(v, kv, _CMP_LT_OQ);
+			count += __builtin_popcount(_mm256_movemask_pd(m));
+		}
+	}
+	else if constexpr (sizeof(T) == 4) {
+		const int32_t bias = std::is_signed<T>::value ? 0 : INT32_MIN;
+		__m256i bv = _mm256_set1_epi32(bias);
+		__m256i kv = _mm256_set1_epi32((int32_t) k ^ bias);
+		for (; i + 8 <= n; i += 8) {
+			__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (keys + i)), bv);
+			__m256i m = Upper ? _mm256_cmpgt_epi32(v, kv) : _mm256_cmpgt_epi32(kv, v);
+			unsigned matches = __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+			count += Upper ? 8 - matches : matches;
+		}
+	}
+	else {
+		const int64_t bias = std::is_signed<T>::value ? 0 : INT64_MIN;
+		__m256i bv = _mm256_set1_epi64x(bias);
+		__m256i kv = _mm256_set1_epi64x((int64_t) k ^ bias);
+		for (; i + 4 <= n; i += 4) {
+			__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (keys + i)), bv);
+			__m256i m = Upper ? _mm256_cmpgt_epi64(v, kv) : _mm256_cmpgt_epi64(kv, v);
+			unsigned matches = __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+			count += Upper ? 4 - matches : matches;
+		}
+	}
+
+	// Handle the keys that don't fill a whole vector.
+	return count + scalarCountKeys<Upper>(keys + i, n - i, k);
+}
+
+#endif
+
+
+// Counts the keys in keys[0, n) that are less than k, or not greater than k if Upper is true.
+// Dispatches to the fastest kernel the CPU supports.
+template <bool Upper, typename T>
+inline unsigned simdCountKeys(const T *keys, unsigned n, T k) {
+#ifdef BTREE_SIMD_X86
+	if (cpuHasAvx2()) {
+		return avx2CountKeys<Upper>(keys, n, k);
+	}
+#endif
+	return scalarCountKeys<Upper>(keys, n, k);
+}
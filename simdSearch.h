@@ -0,0 +1,37 @@
+/* SIMD Key Search
+ * Summary:	Counts how many keys in a sorted node are less than a search key
+ *			using vector compares, for arithmetic keys in their default order.
+ *			The vector kernel is picked at runtime if the CPU supports it,
+ *			and a scalar loop is used otherwise.
+ *			Define BTREE_NO_SIMD to always use the scalar loop.
+ */
+
+
+#pragma once
+
+#include <functional>
+#include <type_traits>
+
+#if !defined(BTREE_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BTREE_SIMD_X86
+#endif
+
+
+// Whether keys of type T ordered by Compare can be searched with simdCountKeys.
+template <typename T, typename Compare>
+struct SimdKeySearch {
+	static const bool enabled =
+		std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+		(sizeof(T) == 4 || sizeof(T) == 8) &&
+		(std::is_same<Compare, std::less<T>>::value || std::is_same<Compare, std::less<>>::value);
+};
+
+
+// Counts the keys in keys[0, n) that are less than k.
+// If Upper is true, counts the keys that k is not less than instead.
+// Since the keys are sorted, this is the index lower_bound (or upper_bound) would find.
+template <bool Upper, typename T>
+unsigned simdCountKeys(const T*, unsigned, T);
+
+
+#include "simdSearch.cpp"
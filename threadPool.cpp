@@ -0,0 +1,108 @@
+/* Thread Pool
+ * Summary:	Worker threads that share batches of indexed tasks with the caller.
+ */
+
+
+#pragma once
+
+
+// Constructor for a pool of threads.
+// threads counts the thread that calls run, so one fewer worker is started.
+inline ThreadPool::ThreadPool(unsigned threads) : task(NULL), next(0), count(0), finished(0), batch(0), stopping(false) {
+	if (threads == 0) {
+		threads = std::thread::hardware_concurrency();
+	}
+	for (unsigned i = 1; i < threads; i++) {
+		workers.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+
+// Destructor.
+inline ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+}
+
+
+// Number of threads that work on a batch.
+inline unsigned ThreadPool::size() const {
+	return workers.size() + 1;
+}
+
+
+// Runs f(i) for every i in [0, n).
+// Indices are handed out one at a time, so uneven tasks balance out.
+inline void ThreadPool::run(std::size_t n, const std::function<void(std::size_t)> &f) {
+	std::unique_lock<std::mutex> guard(lock);
+	task = &f;
+	next = 0;
+	count = n;
+	finished = 0;
+	batch++;
+	wake.notify_all();
+
+	// Work on the batch alongside the workers.
+	while (next < count) {
+		std::size_t i = next++;
+		guard.unlock();
+		f(i);
+		guard.lock();
+		finished++;
+	}
+	done.wait(guard, [this] { return finished == count; });
+	task = NULL;
+}
+
+
+// Runs f(begin, end) over chunks of [0, n) no shorter than grain.
+// Makes a few chunks per thread so a slow chunk doesn't hold up the batch.
+template <typename F>
+void ThreadPool::parallelFor(std::size_t n, std::size_t grain, F f) {
+	std::size_t chunks = 4 * size();
+	if (grain == 0) {
+		grain = 1;
+	}
+	if (n / grain < chunks) {
+		chunks = n / grain;
+	}
+	if (chunks <= 1) {
+		if (n != 0) {
+			f((std::size_t) 0, n);
+		}
+		return;
+	}
+	run(chunks, [&](std::size_t i) {
+		f(n * i / chunks, n * (i + 1) / chunks);
+	});
+}
+
+
+// Waits for batches and works on them until the pool stops.
+inline void ThreadPool::work() {
+	std::unique_lock<std::mutex> guard(lock);
+	unsigned long seen = batch;
+	while (true) {
+		wake.wait(guard, [&] { return stopping || batch != seen; });
+		if (stopping) {
+			return;
+		}
+		seen = batch;
+		while (next < count) {
+			std::size_t i = next++;
+			const std::function<void(std::size_t)> *f = task;
+			guard.unlock();
+			(*f)(i);
+			guard.lock();
+			if (++finished == count) {
+				done.notify_all();
+			}
+		}
+	}
+}
@@ -0,0 +1,76 @@
+/* Thread Pool
+ * Summary:	A fixed set of worker threads that run batches of indexed tasks.
+ *			The calling thread works on each batch too and returns once it is done.
+ *			Used by the b tree's parallel bulk load.
+ */
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class ThreadPool {
+public:
+	// Constructor
+	// Parameter is the number of threads that work on each batch, counting the caller.
+	// 0 means one per hardware thread.
+	ThreadPool(unsigned = 0);
+
+	// Destructor.
+	// Stops and joins the workers.
+	~ThreadPool();
+
+	// Number of threads that work on each batch, counting the caller.
+	unsigned size() const;
+
+	// Runs a task once for each index in [0, n) spread over the pool.
+	// Returns once every index has finished.
+	// Tasks must not throw.
+	void run(std::size_t, const std::function<void(std::size_t)>&);
+
+	// Splits [0, n) into chunks of at least a minimum length and runs
+	// a function on each chunk's begin and end index, spread over the pool.
+	// Runs the whole range on the calling thread if it is too short to split.
+	template <typename F>
+	void parallelFor(std::size_t, std::size_t, F);
+
+private:
+
+	// Loop run by each worker thread.
+	void work();
+
+	// Worker threads. The caller of run is the other thread of the pool.
+	std::vector<std::thread> workers;
+
+	// Guards everything below.
+	std::mutex lock;
+
+	// Signalled when a batch starts or the pool is stopping.
+	std::condition_variable wake;
+
+	// Signalled when the last task of a batch finishes.
+	std::condition_variable done;
+
+	// Task of the current batch.
+	const std::function<void(std::size_t)> *task;
+
+	// Next index to hand out, number of indices, and number finished in the current batch.
+	std::size_t next;
+	std::size_t count;
+	std::size_t finished;
+
+	// Incremented for each batch, so workers never run a batch they didn't see start.
+	unsigned long batch;
+
+	// Set by the destructor.
+	bool stopping;
+};
+
+
+#include "threadPool.cpp"